@@ -0,0 +1,286 @@
+#include <cstring>
+#include <thread>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Bench.hpp"
+#include "Profile.hpp"
+#include "Transport.hpp"
+
+static const Benchmark benchmarks[] = {
+	{"forward", "per-sample cost of PatchbayOut forwarding", forwardBench},
+	{"threads", "forwarding with the modules spread over engine threads", threadsBench},
+	{"churn", "memory over many module creations and deletions", churnBench},
+	{"load", "loading a patch of many routed modules", loadBench},
+	{"labels", "generating unique labels", labelsBench},
+	{"housekeeping", "forwarding with and without channel and light updates", housekeepingBench},
+	{"saveload", "saving and loading the patch data of many modules", saveLoadBench},
+	{"shared", "a label shared between a writer and a reader process", sharedBench},
+};
+
+int BenchOptions::getInt(const std::string &name, int def) const {
+	auto it = values.find(name);
+	return it == values.end() ? def : std::atoi(it->second.c_str());
+}
+
+std::string BenchOptions::getString(const std::string &name, const std::string &def) const {
+	auto it = values.find(name);
+	return it == values.end() ? def : it->second;
+}
+
+static plugin::Plugin *getPlugin() {
+	static plugin::Plugin *p = NULL;
+	if(!p) {
+		p = new plugin::Plugin;
+		init(p);
+	}
+	return p;
+}
+
+engine::Engine *getEngine() {
+	return APP->engine;
+}
+
+engine::Module *addModule(const std::string &slug, json_t *data) {
+	plugin::Model *model = getPlugin()->getModel(slug);
+	assert(model);
+	engine::Module *module = model->createModule();
+	if(data) {
+		module->dataFromJson(data);
+	}
+	getEngine()->addModule(module);
+	return module;
+}
+
+void removeModule(engine::Module *module) {
+	getEngine()->removeModule(module);
+	delete module;
+}
+
+void collectGarbage() {
+	getEngine()->stepFrame();
+	getEngine()->stepFrame();
+	reclaimRetired();
+}
+
+// Threads waiting here are released once all of them arrived. Spins, but
+// yields so more threads than cores still make progress.
+struct SpinBarrier {
+	int total;
+	std::atomic<int> count;
+	std::atomic<int> generation;
+
+	SpinBarrier(int total) : total(total), count(0), generation(0) {}
+
+	void wait() {
+		int gen = generation.load(std::memory_order_acquire);
+		if(count.fetch_add(1, std::memory_order_acq_rel) + 1 == total) {
+			count.store(0, std::memory_order_relaxed);
+			generation.fetch_add(1, std::memory_order_release);
+			return;
+		}
+		while(generation.load(std::memory_order_acquire) == gen) {
+			std::this_thread::yield();
+		}
+	}
+};
+
+// Like Rack's engine, every thread takes the next module off a shared index
+// until all of them were processed, then they wait for each other before
+// the first thread moves on to the next frame.
+void processFrames(const std::vector<engine::Module*> &modules, int64_t frames, int threads) {
+	engine::Engine *engine = getEngine();
+	engine::Module::ProcessArgs args;
+	args.sampleRate = engine->getSampleRate();
+	args.sampleTime = 1.f / args.sampleRate;
+	args.frame = engine->getFrame();
+
+	std::atomic<size_t> next(0);
+	SpinBarrier barrier(threads);
+
+	auto run = [&](int thread) {
+		for(int64_t f = 0; f < frames; f++) {
+			size_t i;
+			while((i = next.fetch_add(1, std::memory_order_relaxed)) < modules.size()) {
+				if(modules[i]->isBypassed()) {
+					modules[i]->processBypass(args);
+				} else {
+					modules[i]->process(args);
+				}
+			}
+			barrier.wait();
+			if(thread == 0) {
+				next.store(0, std::memory_order_relaxed);
+				engine->stepFrame();
+				args.frame = engine->getFrame();
+			}
+			barrier.wait();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(int t = 1; t < threads; t++) {
+		workers.emplace_back(run, t);
+	}
+	run(0);
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+std::vector<std::string> getLabels(engine::Module *module) {
+	std::vector<std::string> labels;
+	json_t *data = module->dataToJson();
+	json_t *labels_json = json_object_get(data, "labels");
+	for(size_t i = 0; i < json_array_size(labels_json); i++) {
+		labels.push_back(json_string_value(json_array_get(labels_json, i)));
+	}
+	json_decref(data);
+	return labels;
+}
+
+size_t getHeapUsage() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+bool checkRoutes(engine::Module *out, engine::Module *in, int routes, int channels) {
+	for(int i = 0; i < routes; i++) {
+		if(out->outputs[i].getChannels() != channels) return false;
+		for(int c = 0; c < channels; c++) {
+			if(out->outputs[i].voltages[c] != in->inputs[i].voltages[c]) return false;
+		}
+	}
+	return true;
+}
+
+void routePorts(engine::Module *out, engine::Module *in, int routes, int channels) {
+	std::vector<std::string> inLabels = getLabels(in);
+
+	json_t *data = json_object();
+	json_t *labels_json = json_array();
+	for(size_t i = 0; i < out->outputs.size(); i++) {
+		bool routed = (int) i < routes && i < inLabels.size();
+		json_array_append_new(labels_json, json_string(routed ? inLabels[i].c_str() : ""));
+	}
+	json_object_set_new(data, "labels", labels_json);
+	out->dataFromJson(data);
+	json_decref(data);
+
+	engine::Engine *engine = getEngine();
+	for(int i = 0; i < routes && i < (int) in->inputs.size(); i++) {
+		engine->setInputConnected(in, i, channels);
+		for(int c = 0; c < channels; c++) {
+			in->inputs[i].voltages[c] = i + c * 0.1f;
+		}
+		engine->setOutputConnected(out, i, true);
+	}
+}
+
+#if defined(__linux__)
+
+CacheMissCounter::CacheMissCounter() {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+CacheMissCounter::~CacheMissCounter() {
+	if(fd >= 0) close(fd);
+}
+
+void CacheMissCounter::start() {
+	if(fd < 0) return;
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+uint64_t CacheMissCounter::stop() {
+	if(fd < 0) return 0;
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	uint64_t count = 0;
+	if(read(fd, &count, sizeof(count)) != sizeof(count)) return 0;
+	return count;
+}
+
+#else
+
+CacheMissCounter::CacheMissCounter() {}
+CacheMissCounter::~CacheMissCounter() {}
+void CacheMissCounter::start() {}
+uint64_t CacheMissCounter::stop() {
+	return 0;
+}
+
+#endif
+
+static void printUsage() {
+	std::printf("usage: bench [benchmark] [--option value]...\n\n");
+	std::printf("Without a benchmark, all of them run with their default options.\n\n");
+	for(const Benchmark &b : benchmarks) {
+		std::printf("  %-10s %s\n", b.name, b.description);
+	}
+}
+
+int main(int argc, char **argv) {
+	std::string name;
+	BenchOptions options;
+
+	for(int i = 1; i < argc; i++) {
+		if(!std::strncmp(argv[i], "--", 2) && i + 1 < argc) {
+			options.values[argv[i] + 2] = argv[i + 1];
+			i++;
+		} else if(name.empty() && argv[i][0] != '-') {
+			name = argv[i];
+		} else {
+			printUsage();
+			return 1;
+		}
+	}
+
+	int ret = 0;
+	bool found = false;
+	for(const Benchmark &b : benchmarks) {
+		if(name.empty() || name == b.name) {
+			found = true;
+			std::printf("== %s: %s\n", b.name, b.description);
+			ret |= b.run(options);
+			std::printf("\n");
+		}
+	}
+
+	if(!found) {
+		printUsage();
+		return 1;
+	}
+
+#ifdef PATCHBAY_PROFILE
+	std::printf("== profile\n");
+	for(int s = 0; s < NUM_PROFILE_SECTIONS; s++) {
+		profile::Stats stats = profile::getStats((ProfileSection) s);
+		std::printf("%-32s n=%llu p50<%lluns p99<%lluns max=%lluns\n", profile::getSectionName((ProfileSection) s),
+			(unsigned long long) stats.count, (unsigned long long) stats.p50, (unsigned long long) stats.p99, (unsigned long long) stats.max);
+	}
+#endif
+	return ret;
+}
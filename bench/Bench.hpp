@@ -0,0 +1,96 @@
+#pragma once
+
+// Headless benchmarks of the Patchbay modules. The plugin sources are built
+// against the stub of the Rack SDK in stub/, modules are created through
+// their Models and driven through the engine API like Rack does, so the
+// numbers cover the same code paths minus Rack itself.
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <rack.hpp>
+
+// `--name value` pairs from the command line.
+struct BenchOptions {
+	std::map<std::string, std::string> values;
+
+	int getInt(const std::string &name, int def) const;
+	std::string getString(const std::string &name, const std::string &def) const;
+};
+
+typedef int (*BenchFunction)(const BenchOptions &options);
+
+struct Benchmark {
+	const char *name;
+	const char *description;
+	BenchFunction run;
+};
+
+// The benchmarks, in the order they run without arguments.
+int forwardBench(const BenchOptions &options);
+int threadsBench(const BenchOptions &options);
+int churnBench(const BenchOptions &options);
+int loadBench(const BenchOptions &options);
+int labelsBench(const BenchOptions &options);
+int housekeepingBench(const BenchOptions &options);
+int saveLoadBench(const BenchOptions &options);
+int sharedBench(const BenchOptions &options);
+
+engine::Engine *getEngine();
+
+// Create a module from the plugin's model with this slug and add it to the
+// engine, which sends it an AddEvent. With data it's loaded from that first,
+// like Rack does when it loads a patch.
+engine::Module *addModule(const std::string &slug, json_t *data = NULL);
+
+// Remove it from the engine and delete it.
+void removeModule(engine::Module *module);
+
+// Move the engine on far enough for everything retired by removed modules
+// to be freed, and free it.
+void collectGarbage();
+
+// Process every module once per frame, or bypass it, advancing the engine
+// frame counter, on this and threads - 1 worker threads.
+void processFrames(const std::vector<engine::Module*> &modules, int64_t frames, int threads = 1);
+
+// Make ports [0, routes) of PatchbayOut out select the labels of the same
+// ports of PatchbayIn in, through the patch data like a loaded patch, and
+// connect both ends.
+void routePorts(engine::Module *out, engine::Module *in, int routes, int channels);
+
+// Bytes allocated on the heap, or 0 where that's not known.
+size_t getHeapUsage();
+
+// Whether every routed output of out carries what's patched into in.
+bool checkRoutes(engine::Module *out, engine::Module *in, int routes, int channels);
+
+// Labels of all ports of a Patchbay module, from its patch data.
+std::vector<std::string> getLabels(engine::Module *module);
+
+struct BenchTimer {
+	std::chrono::steady_clock::time_point start;
+
+	BenchTimer() : start(std::chrono::steady_clock::now()) {}
+
+	double getNanoseconds() const {
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+// Hardware cache misses of this process over a section, on Linux when perf
+// events are permitted. Counts the threads started while it's running too.
+struct CacheMissCounter {
+	int fd = -1;
+
+	CacheMissCounter();
+	~CacheMissCounter();
+
+	bool isAvailable() const {
+		return fd >= 0;
+	}
+	void start();
+	uint64_t stop();
+};
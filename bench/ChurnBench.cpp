@@ -0,0 +1,79 @@
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+
+// Create a routed PatchbayIn/PatchbayOut pair, run it for a few frames and
+// delete it, --cycles times. The registry, the retired list and the heap
+// should be back where they were after every cycle: labels are released
+// with the last port holding them and handles are reused. A bypassed
+// PatchbayOut routed from each PatchbayIn too mustn't hold up freeing their
+// buffers.
+int churnBench(const BenchOptions &options) {
+	int cycles = options.getInt("cycles", 10000);
+	int routes = clamp(options.getInt("routes", 8), 0, 8);
+	int reportEvery = std::max(1, cycles / 10);
+	LabelRegistry &registry = Patchbay::registry;
+
+	size_t baseLabels = registry.size();
+	size_t baseHandles = registry.end();
+	// measured after the first cycle, once the pools and tables are warm
+	size_t baseHeap = 0;
+	size_t maxHandles = 0;
+
+	engine::Module *bypassed = addModule("PatchbayOut");
+	getEngine()->bypassModule(bypassed, true);
+	size_t maxRetired = 0;
+
+	std::printf("%d cycles, %d routes per module\n", cycles, routes);
+	std::printf("%8s %8s %8s %8s %8s %12s %10s\n", "cycle", "labels", "handles", "sources", "dests", "heap KiB", "us/cycle");
+
+	BenchTimer timer;
+	for(int cycle = 1; cycle <= cycles; cycle++) {
+		engine::Module *in = addModule("PatchbayIn");
+		engine::Module *out = addModule("PatchbayOut");
+		routePorts(out, in, routes, 1);
+		routePorts(bypassed, in, 1, 1);
+		processFrames({in, out, bypassed}, 4);
+		maxHandles = std::max(maxHandles, (size_t) registry.end());
+
+		removeModule(out);
+		removeModule(in);
+		collectGarbage();
+		// the bypassed module still has to apply the removal of its route
+		maxRetired = std::max(maxRetired, getRetired().size());
+
+		if(cycle == 1) {
+			baseHeap = getHeapUsage();
+		}
+		if(cycle % reportEvery == 0) {
+			std::printf("%8d %8d %8d %8d %8d %12.1f %10.2f\n", cycle, (int) registry.size(), (int) registry.end() - 1,
+				(int) registry.sourceModules.size(), (int) registry.destinations.size(),
+				getHeapUsage() / 1024.0, timer.getNanoseconds() / 1000.0 / cycle);
+		}
+	}
+
+	processFrames({bypassed}, 1);
+	removeModule(bypassed);
+	collectGarbage();
+
+	int ret = 0;
+	if(maxRetired > 1) {
+		std::printf("FAILED: up to %d deleted modules' buffers were waiting to be freed\n", (int) maxRetired);
+		ret = 1;
+	}
+	if(registry.size() != baseLabels || !registry.sourceModules.empty() || !registry.destinations.empty() || !getRetired().empty()) {
+		std::printf("FAILED: the registry or the retired list kept entries of deleted modules\n");
+		ret = 1;
+	}
+	// one pair's labels plus whatever the test labels of other benchmarks left
+	if(maxHandles > baseHandles + 2 * MAX_PATCHBAY_PORTS) {
+		std::printf("FAILED: handles aren't reused, %d were handed out\n", (int) maxHandles - 1);
+		ret = 1;
+	}
+	// allow for allocator noise, a leak of even a label per cycle is more
+	size_t heap = getHeapUsage();
+	if(baseHeap && heap > baseHeap + 64 * 1024) {
+		std::printf("FAILED: the heap grew by %.1f KiB\n", (heap - baseHeap) / 1024.0);
+		ret = 1;
+	}
+	return ret;
+}
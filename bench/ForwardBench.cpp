@@ -0,0 +1,134 @@
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+
+// Bypassing a PatchbayIn has to silence its routes, not leave them holding
+// the last frame it published.
+static int checkBypass(int routes, int channels) {
+	engine::Module *in = addModule("PatchbayIn");
+	engine::Module *out = addModule("PatchbayOut");
+	routePorts(out, in, routes, channels);
+	processFrames({in, out}, 2 * Patchbay::HOUSEKEEPING_DIVISION);
+
+	getEngine()->bypassModule(in, true);
+	processFrames({in, out}, 2 * Patchbay::HOUSEKEEPING_DIVISION);
+	bool silent = true;
+	for(int i = 0; i < routes; i++) {
+		// a connected output keeps 1 channel, at 0V
+		silent = silent && out->outputs[i].getChannels() <= 1 && out->outputs[i].getVoltage() == 0.f;
+	}
+
+	getEngine()->bypassModule(in, false);
+	processFrames({in, out}, 2 * Patchbay::HOUSEKEEPING_DIVISION);
+	bool restored = checkRoutes(out, in, routes, channels);
+
+	removeModule(out);
+	removeModule(in);
+	collectGarbage();
+
+	if(!silent || !restored) {
+		std::printf("FAILED: routes from a bypassed PatchbayIn %s\n", !silent ? "kept their last frame" : "didn't come back");
+		return 1;
+	}
+	return 0;
+}
+
+// A port forwarded at a linear control rate ramps towards its source. When
+// the source gains channels, the new ones have to start at their value
+// instead of ramping from whatever the port had beyond its channel count.
+static int checkRamp() {
+	const int division = 8;
+	const int channels = 4;
+	engine::Module *in = addModule("PatchbayIn");
+	engine::Module *out = addModule("PatchbayOut");
+	routePorts(out, in, 1, 1);
+
+	json_t *data = json_object();
+	json_t *rates_json = json_array();
+	json_t *rate_json = json_object();
+	json_object_set_new(rate_json, "division", json_integer(division));
+	json_object_set_new(rate_json, "linear", json_true());
+	json_array_append_new(rates_json, rate_json);
+	json_object_set_new(data, "rates", rates_json);
+	out->dataFromJson(data);
+	json_decref(data);
+
+	in->inputs[0].voltages[0] = 1.f;
+	processFrames({in, out}, 4 * division);
+
+	getEngine()->setInputConnected(in, 0, channels);
+	for(int c = 0; c < channels; c++) {
+		in->inputs[0].voltages[c] = 2.f;
+	}
+	bool ok = true;
+	for(int f = 0; f < 4 * division; f++) {
+		processFrames({in, out}, 1);
+		if(out->outputs[0].getChannels() != channels) continue;
+		for(int c = 1; c < channels; c++) {
+			ok = ok && out->outputs[0].voltages[c] == 2.f;
+		}
+	}
+	ok = ok && out->outputs[0].getChannels() == channels && out->outputs[0].voltages[0] == 2.f;
+
+	removeModule(out);
+	removeModule(in);
+	collectGarbage();
+
+	if(!ok) {
+		std::printf("FAILED: channels added to a ramped route didn't start at their source\n");
+		return 1;
+	}
+	return 0;
+}
+
+// PatchbayIn/PatchbayOut pairs with routes ports routed between them, for
+// 1, 2, 4... up to --pairs pairs, so the curve shows how the per-route cost
+// holds up once the buffers no longer fit in cache.
+int forwardBench(const BenchOptions &options) {
+	int maxPairs = options.getInt("pairs", 64);
+	int routes = clamp(options.getInt("routes", 8), 0, 8);
+	int channels = clamp(options.getInt("channels", 16), 1, PORT_MAX_CHANNELS);
+	int64_t frames = options.getInt("frames", 48000);
+
+	CacheMissCounter misses;
+	std::printf("%d routes per module, %d channels, %lld frames\n", routes, channels, (long long) frames);
+	std::printf("%8s %12s %12s %16s\n", "pairs", "ns/frame", "ns/route", "misses/frame");
+
+	for(int pairs = 1; pairs <= maxPairs; pairs *= 2) {
+		std::vector<engine::Module*> modules;
+		for(int p = 0; p < pairs; p++) {
+			engine::Module *in = addModule("PatchbayIn");
+			engine::Module *out = addModule("PatchbayOut");
+			routePorts(out, in, routes, channels);
+			modules.push_back(in);
+			modules.push_back(out);
+		}
+
+		// applies the queued routes and warms the caches
+		processFrames(modules, 1000);
+
+		misses.start();
+		BenchTimer timer;
+		processFrames(modules, frames);
+		double ns = timer.getNanoseconds() / frames;
+		uint64_t missCount = misses.stop();
+
+		std::string missText = misses.isAvailable() ? string::f("%.1f", (double) missCount / frames) : "n/a";
+		std::printf("%8d %12.1f %12.2f %16s\n", pairs, ns, routes ? ns / (pairs * routes) : 0.0, missText.c_str());
+
+		bool ok = true;
+		for(size_t m = 0; m < modules.size(); m += 2) {
+			ok = ok && checkRoutes(modules[m + 1], modules[m], routes, channels);
+		}
+		for(engine::Module *module : modules) {
+			removeModule(module);
+		}
+		collectGarbage();
+
+		if(!ok) {
+			std::printf("FAILED: outputs don't match their routed inputs\n");
+			return 1;
+		}
+	}
+
+	return checkBypass(routes, channels) | checkRamp();
+}
@@ -0,0 +1,69 @@
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+
+// PatchbayOut updates channel counts and lights only every
+// HOUSEKEEPING_DIVISION frames, starting on the frame a route is applied, so
+// all modules routed together do it on the same frames. Timing every frame
+// on its own, the frames with housekeeping cost what every frame did when it
+// ran per sample, the mean over all frames is what it costs now.
+int housekeepingBench(const BenchOptions &options) {
+	int pairs = options.getInt("pairs", 16);
+	int routes = clamp(options.getInt("routes", 8), 0, 8);
+	int channels = clamp(options.getInt("channels", 16), 1, PORT_MAX_CHANNELS);
+	int64_t frames = options.getInt("frames", 48000);
+	const int division = Patchbay::HOUSEKEEPING_DIVISION;
+
+	std::vector<engine::Module*> modules;
+	for(int p = 0; p < pairs; p++) {
+		engine::Module *in = addModule("PatchbayIn");
+		engine::Module *out = addModule("PatchbayOut");
+		routePorts(out, in, routes, channels);
+		modules.push_back(in);
+		modules.push_back(out);
+	}
+
+	// Frames since the routes were applied, which happens on the first one.
+	// A whole number of periods, so the next frame has housekeeping.
+	int64_t processed = 1024 * division;
+	processFrames(modules, processed);
+
+	double housekeepingNs = 0.0, otherNs = 0.0;
+	int64_t housekeepingFrames = 0;
+	for(int64_t f = 0; f < frames; f++) {
+		bool housekeeping = processed % division == 0;
+		BenchTimer timer;
+		processFrames(modules, 1);
+		double ns = timer.getNanoseconds();
+		processed++;
+
+		if(housekeeping) {
+			housekeepingNs += ns;
+			housekeepingFrames++;
+		} else {
+			otherNs += ns;
+		}
+	}
+
+	double before = housekeepingNs / housekeepingFrames;
+	double after = (housekeepingNs + otherNs) / frames;
+	std::printf("%d pairs, %d routes per module, %d channels, %lld frames\n", pairs, routes, channels, (long long) frames);
+	std::printf("%-28s %12s %12s\n", "housekeeping", "ns/frame", "ns/route");
+	std::printf("%-28s %12.1f %12.2f\n", "every frame (before)", before, before / (pairs * routes));
+	std::printf("%-28s %12.1f %12.2f\n", string::f("every %d frames (after)", division).c_str(), after, after / (pairs * routes));
+	std::printf("%-28s %12.1f %12.2f\n", "frames without", otherNs / (frames - housekeepingFrames), otherNs / (frames - housekeepingFrames) / (pairs * routes));
+
+	int ret = 0;
+	for(size_t m = 0; m < modules.size(); m += 2) {
+		if(!checkRoutes(modules[m + 1], modules[m], routes, channels)) {
+			std::printf("FAILED: outputs don't match their routed inputs\n");
+			ret = 1;
+			break;
+		}
+	}
+
+	for(engine::Module *module : modules) {
+		removeModule(module);
+	}
+	collectGarbage();
+	return ret;
+}
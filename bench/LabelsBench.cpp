@@ -0,0 +1,53 @@
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+
+// Generate --labels labels, holding on to all of them like ports do, in ten
+// batches. The cost per label should stay the same as the registry fills up,
+// generate() never retries on labels it handed out itself. Batches in which
+// the hash table doubles cost more.
+int labelsBench(const BenchOptions &options) {
+	int count = options.getInt("labels", 100000);
+	int batch = std::max(1, count / 10);
+	LabelRegistry &registry = Patchbay::registry;
+	size_t baseLabels = registry.size();
+
+	std::printf("%d labels\n", count);
+	std::printf("%10s %12s %10s\n", "labels", "ns/label", "length");
+
+	std::vector<LabelHandle> handles;
+	handles.reserve(count);
+	while((int) handles.size() < count) {
+		int n = std::min(batch, count - (int) handles.size());
+		BenchTimer timer;
+		for(int i = 0; i < n; i++) {
+			LabelHandle h = registry.generate();
+			registry.retain(h);
+			handles.push_back(h);
+		}
+		double ns = timer.getNanoseconds() / n;
+		std::printf("%10d %12.1f %10d\n", (int) handles.size(), ns, (int) registry.generatedLength);
+	}
+
+	int ret = 0;
+	// every one of them new, and found again by name
+	if(registry.size() != baseLabels + count) {
+		std::printf("FAILED: %d labels were handed out twice\n", (int) (baseLabels + count - registry.size()));
+		ret = 1;
+	}
+	for(LabelHandle h : handles) {
+		if(registry.find(registry.name(h)) != h) {
+			std::printf("FAILED: label %s isn't found by name\n", registry.name(h).c_str());
+			ret = 1;
+			break;
+		}
+	}
+
+	for(LabelHandle h : handles) {
+		registry.release(h);
+	}
+	if(registry.size() != baseLabels) {
+		std::printf("FAILED: labels weren't released\n");
+		ret = 1;
+	}
+	return ret;
+}
@@ -0,0 +1,93 @@
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+
+// Patch data of a Patchbay module with the given labels.
+static json_t *labelsData(const std::vector<std::string> &labels) {
+	json_t *data = json_object();
+	json_t *labels_json = json_array();
+	for(const std::string &lbl : labels) {
+		json_array_append_new(labels_json, json_string(lbl.c_str()));
+	}
+	json_object_set_new(data, "version", json_integer(2));
+	json_object_set_new(data, "labels", labels_json);
+	return data;
+}
+
+// Load a patch of --modules modules, half of them PatchbayIn and half
+// PatchbayOut with every port routed from one of the inputs, the way Rack
+// does: each module is loaded from its data and then added to the engine.
+// Routes are resolved when their endpoint is added, so the cost should be
+// linear in the number of modules whichever end comes first in the patch.
+int loadBench(const BenchOptions &options) {
+	int pairs = std::max(1, options.getInt("modules", 1000) / 2);
+	const int ports = 8;
+
+	std::vector<json_t*> inData, outData;
+	for(int p = 0; p < pairs; p++) {
+		std::vector<std::string> labels;
+		for(int i = 0; i < ports; i++) {
+			labels.push_back(string::f("bus%d.%d", p, i));
+		}
+		inData.push_back(labelsData(labels));
+		// routed from another module than its neighbour, like a real patch
+		std::vector<std::string> routed;
+		for(int i = 0; i < ports; i++) {
+			routed.push_back(string::f("bus%d.%d", (p * 7 + i) % pairs, (i + 3) % ports));
+		}
+		outData.push_back(labelsData(routed));
+	}
+
+	std::printf("%d modules, %d ports each\n", 2 * pairs, ports);
+	std::printf("%-12s %12s %12s %10s\n", "order", "ms", "us/module", "routed");
+
+	int ret = 0;
+	for(int outsFirst = 0; outsFirst < 2; outsFirst++) {
+		std::vector<engine::Module*> ins, outs;
+		BenchTimer timer;
+		for(int p = 0; p < pairs; p++) {
+			if(outsFirst) {
+				outs.push_back(addModule("PatchbayOut", outData[p]));
+			} else {
+				ins.push_back(addModule("PatchbayIn", inData[p]));
+			}
+		}
+		for(int p = 0; p < pairs; p++) {
+			if(outsFirst) {
+				ins.push_back(addModule("PatchbayIn", inData[p]));
+			} else {
+				outs.push_back(addModule("PatchbayOut", outData[p]));
+			}
+		}
+		double ns = timer.getNanoseconds();
+
+		// every port of every PatchbayOut should have found its source
+		int routed = 0;
+		for(engine::Module *module : outs) {
+			Patchbay *out = dynamic_cast<Patchbay*>(module);
+			for(int i = 0; i < ports; i++) {
+				routed += Patchbay::registry.hasSource(out->label[i]);
+			}
+		}
+
+		std::printf("%-12s %12.2f %12.2f %10d\n", outsFirst ? "outs first" : "ins first",
+			ns / 1e6, ns / 1e3 / (2 * pairs), routed);
+		if(routed != pairs * ports) {
+			std::printf("FAILED: %d of %d routes weren't resolved\n", pairs * ports - routed, pairs * ports);
+			ret = 1;
+		}
+
+		for(engine::Module *module : outs) {
+			removeModule(module);
+		}
+		for(engine::Module *module : ins) {
+			removeModule(module);
+		}
+		collectGarbage();
+	}
+
+	for(int p = 0; p < pairs; p++) {
+		json_decref(inData[p]);
+		json_decref(outData[p]);
+	}
+	return ret;
+}
@@ -0,0 +1,125 @@
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+
+// A patch as Rack saves it, reduced to what matters here: the model and the
+// data of every module.
+static json_t *savePatch(const std::vector<engine::Module*> &modules) {
+	json_t *modules_json = json_array();
+	for(engine::Module *module : modules) {
+		json_t *module_json = json_object();
+		json_object_set_new(module_json, "model", json_string(module->model->slug.c_str()));
+		json_object_set_new(module_json, "data", module->dataToJson());
+		json_array_append_new(modules_json, module_json);
+	}
+	json_t *patch = json_object();
+	json_object_set_new(patch, "modules", modules_json);
+	return patch;
+}
+
+static std::vector<engine::Module*> loadPatch(json_t *patch) {
+	std::vector<engine::Module*> modules;
+	json_t *modules_json = json_object_get(patch, "modules");
+	for(size_t i = 0; i < json_array_size(modules_json); i++) {
+		json_t *module_json = json_array_get(modules_json, i);
+		const char *slug = json_string_value(json_object_get(module_json, "model"));
+		modules.push_back(addModule(slug, json_object_get(module_json, "data")));
+	}
+	return modules;
+}
+
+// Rewrite the labels of every module as version 1 data, one "label<N>" key
+// per port, to compare with the array of version 2.
+static void downgradePatch(json_t *patch) {
+	json_t *modules_json = json_object_get(patch, "modules");
+	for(size_t i = 0; i < json_array_size(modules_json); i++) {
+		json_t *data = json_object_get(json_array_get(modules_json, i), "data");
+		json_t *labels = json_object_get(data, "labels");
+
+		for(size_t j = 0; j < json_array_size(labels); j++) {
+			json_object_set_new(data, string::f("label%d", (int) j).c_str(), json_string(json_string_value(json_array_get(labels, j))));
+		}
+		json_object_del(data, "labels");
+		json_object_del(data, "version");
+	}
+}
+
+static void removeModules(std::vector<engine::Module*> &modules) {
+	for(engine::Module *module : modules) {
+		removeModule(module);
+	}
+	modules.clear();
+	collectGarbage();
+}
+
+// Whether modules carry the same labels as saved, with every one routed.
+static bool checkLoaded(const std::vector<engine::Module*> &modules, const std::vector<std::vector<std::string>> &saved) {
+	for(size_t m = 0; m < modules.size(); m++) {
+		Patchbay *module = dynamic_cast<Patchbay*>(modules[m]);
+		for(int i = 0; i < module->numPorts; i++) {
+			if(module->getLabelText(i) != saved[m][i] || !Patchbay::registry.hasSource(module->label[i])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Save a patch of --modules routed PatchbayIn/PatchbayOut modules to text
+// and load it back, in the current format and in version 1.
+int saveLoadBench(const BenchOptions &options) {
+	int pairs = std::max(1, options.getInt("modules", 1000) / 2);
+
+	std::vector<engine::Module*> modules;
+	for(int p = 0; p < pairs; p++) {
+		engine::Module *in = addModule("PatchbayIn");
+		engine::Module *out = addModule("PatchbayOut");
+		routePorts(out, in, 8, 1);
+		modules.push_back(in);
+		modules.push_back(out);
+	}
+	std::vector<std::vector<std::string>> saved;
+	for(engine::Module *module : modules) {
+		saved.push_back(getLabels(module));
+	}
+
+	std::printf("%d modules\n", 2 * pairs);
+	std::printf("%-10s %-6s %12s %12s %12s\n", "format", "", "ms", "us/module", "KiB");
+
+	BenchTimer saveTimer;
+	json_t *patch = savePatch(modules);
+	char *text = json_dumps(patch, 0);
+	double saveNs = saveTimer.getNanoseconds();
+	json_decref(patch);
+	std::printf("%-10s %-6s %12.2f %12.2f %12.1f\n", "version 2", "save", saveNs / 1e6, saveNs / 1e3 / modules.size(), std::strlen(text) / 1024.0);
+	removeModules(modules);
+
+	int ret = 0;
+	for(int version = 2; version >= 1; version--) {
+		char *input = text;
+		if(version == 1) {
+			json_t *v1 = json_loads(text, 0, NULL);
+			downgradePatch(v1);
+			input = json_dumps(v1, 0);
+			json_decref(v1);
+		}
+
+		BenchTimer loadTimer;
+		json_t *loaded = json_loads(input, 0, NULL);
+		modules = loadPatch(loaded);
+		double loadNs = loadTimer.getNanoseconds();
+		json_decref(loaded);
+
+		std::printf("%-10s %-6s %12.2f %12.2f %12.1f\n", string::f("version %d", version).c_str(), "load",
+			loadNs / 1e6, loadNs / 1e3 / modules.size(), std::strlen(input) / 1024.0);
+		if(modules.size() != saved.size() || !checkLoaded(modules, saved)) {
+			std::printf("FAILED: version %d data didn't load back the same routes\n", version);
+			ret = 1;
+		}
+
+		removeModules(modules);
+		if(input != text) std::free(input);
+	}
+
+	std::free(text);
+	return ret;
+}
@@ -0,0 +1,292 @@
+#include <cstdlib>
+#include <thread>
+
+#include "Bench.hpp"
+#include "Patchbay.hpp"
+#include "SharedTransport.hpp"
+
+#ifdef PATCHBAY_SHARED_TRANSPORT
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Frames are numbered from 1 on channel 0 of the shared port, the other
+// channels are offset from it so a torn frame shows.
+static const int SHARED_CHANNELS = 4;
+static const float CHANNEL_OFFSET = 100000.f;
+// how far either engine may run ahead of the other, in frames, like two
+// engines on the same clock processing in blocks
+static const int64_t ENGINE_BLOCK = 64;
+static const double TIMEOUT_NS = 20e9;
+
+// Shared by the processes of the benchmark, mapped before they're forked.
+struct SharedBenchState {
+	std::atomic<bool> writerReady;
+	std::atomic<bool> readerReady;
+	std::atomic<bool> readerDone;
+	std::atomic<bool> finished;
+	// engine frames processed by each end
+	std::atomic<int64_t> writerFrames;
+	std::atomic<int64_t> readerFrames;
+
+	// results, written by the process that measured them before it exits
+	int64_t dropped;
+	int64_t received;
+	int64_t lost;
+	int64_t torn;
+	int64_t reordered;
+	int64_t maxLatency;
+	double latencySum;
+	int64_t underruns;
+	int64_t skipped;
+	int outputChannels;
+};
+
+// Spin until done() or the timeout, return whether it's done.
+template <typename F>
+static bool waitFor(F done) {
+	BenchTimer timer;
+	while(!done()) {
+		if(timer.getNanoseconds() > TIMEOUT_NS) return false;
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+static json_t *sharedData(const std::string &label, const char *key) {
+	json_t *data = json_object();
+	json_t *labels_json = json_array();
+	json_array_append_new(labels_json, json_string(label.c_str()));
+	json_object_set_new(data, "version", json_integer(2));
+	json_object_set_new(data, "labels", labels_json);
+	json_object_set_new(data, key, json_true());
+	return data;
+}
+
+static uint64_t getCounter(engine::Module *module, const std::string &name) {
+	PatchbayCounterList counters;
+	dynamic_cast<Patchbay*>(module)->getCounters(counters);
+	for(auto &counter : counters) {
+		if(counter.first == name) return counter.second;
+	}
+	return 0;
+}
+
+// A PatchbayIn sharing label, processed alongside the reader. A third of the
+// way in it floods the ring between two frames, which the reader has to
+// catch up with by skipping, and two thirds in it stops publishing for a
+// ring's worth of frames, which the reader has to hold the last frame
+// through. It goes on past frames until the reader saw them, in case it's
+// buffering again.
+static int runWriter(SharedBenchState *state, const std::string &label, int64_t frames) {
+	json_t *data = sharedData(label, "shared");
+	engine::Module *in = addModule("PatchbayIn", data);
+	json_decref(data);
+	getEngine()->setInputConnected(in, 0, SHARED_CHANNELS);
+	state->writerReady.store(true, std::memory_order_release);
+
+	if(!waitFor([&]() {return state->readerReady.load(std::memory_order_acquire);})) return 1;
+
+	auto done = [&]() {return state->readerDone.load(std::memory_order_acquire);};
+	auto write = [&](int64_t f) {
+		for(int c = 0; c < SHARED_CHANNELS; c++) {
+			in->inputs[0].voltages[c] = f + c * CHANNEL_OFFSET;
+		}
+		processFrames({in}, 1);
+	};
+
+	for(int64_t f = 1; !done(); f++) {
+		if(f == frames / 3) {
+			int64_t flood = SHARED_MAX_LATENCY + ENGINE_BLOCK;
+			for(int64_t i = 0; i < flood; i++) {
+				write(f++);
+			}
+		}
+		if(f == 2 * frames / 3) {
+			state->writerFrames.fetch_add(SHARED_RING_SIZE);
+		}
+		if(!waitFor([&]() {return state->writerFrames.load() - state->readerFrames.load() < ENGINE_BLOCK || done();})) return 1;
+		write(f);
+		state->writerFrames.fetch_add(1);
+	}
+
+	state->dropped = getCounter(in, "port1_shared_frames_dropped");
+	// keep the segment until the others are done with it
+	if(!waitFor([&]() {return state->finished.load(std::memory_order_acquire);})) return 1;
+	removeModule(in);
+	collectGarbage();
+	return 0;
+}
+
+// A PatchbayOut routed from label in the writer's process, reading until it
+// saw frame frames. Every frame it doesn't see has to be accounted for as
+// skipped by the reader or dropped by the writer.
+static int runReader(SharedBenchState *state, const std::string &label, int64_t frames) {
+	if(!waitFor([&]() {return state->writerReady.load(std::memory_order_acquire);})) return 1;
+
+	json_t *data = sharedData(label, "receiveRemote");
+	engine::Module *out = addModule("PatchbayOut", data);
+	json_decref(data);
+	getEngine()->setOutputConnected(out, 0, true);
+	// the module's source, for its counters
+	RemoteSource *source = acquireRemoteSource(label);
+	if(!source) return 1;
+	state->readerReady.store(true, std::memory_order_release);
+
+	int64_t last = 0;
+	while(last < frames) {
+		if(!waitFor([&]() {return state->readerFrames.load() - state->writerFrames.load() < ENGINE_BLOCK;})) break;
+		processFrames({out}, 1);
+		state->readerFrames.fetch_add(1);
+
+		int latency = source->latency.load();
+		state->maxLatency = std::max(state->maxLatency, (int64_t) latency);
+		state->latencySum += latency;
+
+		const float *v = out->outputs[0].voltages;
+		int64_t frame = (int64_t) v[0];
+		if(frame == last) continue;
+		if(frame < last) {
+			state->reordered++;
+			continue;
+		}
+		for(int c = 1; c < SHARED_CHANNELS; c++) {
+			if(v[c] != frame + c * CHANNEL_OFFSET) {
+				state->torn++;
+				break;
+			}
+		}
+		state->received++;
+		state->lost += frame - last - 1;
+		last = frame;
+	}
+
+	state->readerDone.store(true, std::memory_order_release);
+	state->underruns = source->underruns.load();
+	state->skipped = source->skipped.load();
+	state->outputChannels = out->outputs[0].getChannels();
+	releaseRemoteSource(source);
+	removeModule(out);
+	collectGarbage();
+	return last >= frames ? 0 : 1;
+}
+
+// Fork and run f in the child, return its pid. The parent's buffered output
+// is flushed first so the child doesn't print it again.
+template <typename F>
+static pid_t forkProcess(F f) {
+	std::fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0) {
+		std::_Exit(f());
+	}
+	return pid;
+}
+
+static bool exitedCleanly(pid_t pid) {
+	int status = 0;
+	return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// A PatchbayIn sharing a label and a PatchbayOut receiving it, each in its own
+// process forked from this one, over --frames frames, several times the
+// ring size so it wraps around. This process checks that neither a second
+// reader nor a second writer can open the label meanwhile.
+int sharedBench(const BenchOptions &options) {
+	int64_t frames = std::max((int64_t) options.getInt("frames", 6 * SHARED_RING_SIZE), (int64_t) (3 * SHARED_RING_SIZE));
+	std::string label = string::f("bench-shared-%d", (int) getpid());
+
+	void *p = mmap(NULL, sizeof(SharedBenchState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED) {
+		std::printf("FAILED: could not map the state shared with the other processes\n");
+		return 1;
+	}
+	SharedBenchState *state = new (p) SharedBenchState();
+
+	BenchTimer timer;
+	pid_t writer = forkProcess([&]() {return runWriter(state, label, frames);});
+	pid_t reader = forkProcess([&]() {return runReader(state, label, frames);});
+
+	int ret = 0;
+	if(waitFor([&]() {return state->readerReady.load(std::memory_order_acquire);})) {
+		RemoteSource *second = acquireRemoteSource(label);
+		if(second) {
+			std::printf("FAILED: a second process could claim the label while it's read\n");
+			releaseRemoteSource(second);
+			ret = 1;
+		}
+		SharedWriter *other = openSharedWriter(label);
+		if(other) {
+			std::printf("FAILED: a second process could share the label while it's written\n");
+			closeSharedWriter(other);
+			ret = 1;
+		}
+	}
+
+	bool readerOk = exitedCleanly(reader);
+	// the reader let go of its claim, so this process may read now
+	RemoteSource *next = acquireRemoteSource(label);
+	if(next) {
+		releaseRemoteSource(next);
+	} else {
+		std::printf("FAILED: the label couldn't be read again once its reader left\n");
+		ret = 1;
+	}
+	state->finished.store(true, std::memory_order_release);
+	bool writerOk = exitedCleanly(writer);
+	collectGarbage();
+	double ns = timer.getNanoseconds();
+
+	if(!readerOk || !writerOk) {
+		std::printf("FAILED: the %s process failed or timed out\n", !writerOk ? "writer" : "reader");
+		ret = 1;
+	}
+
+	double sampleRate = getEngine()->getSampleRate();
+	double meanLatency = state->readerFrames.load() ? state->latencySum / state->readerFrames.load() : 0.0;
+	std::printf("%lld frames through a ring of %d, %.1f wraps, %d channels, %.1f ms\n", (long long) frames, (int) SHARED_RING_SIZE,
+		(double) frames / SHARED_RING_SIZE, state->outputChannels, ns / 1e6);
+	std::printf("%10s %10s %10s %10s %10s %10s %12s %12s\n", "received", "skipped", "dropped", "underruns", "torn", "reordered", "max latency", "mean latency");
+	std::printf("%10lld %10lld %10lld %10lld %10lld %10lld %9lld fr %9.1f fr\n",
+		(long long) state->received, (long long) state->skipped, (long long) state->dropped, (long long) state->underruns,
+		(long long) state->torn, (long long) state->reordered, (long long) state->maxLatency, meanLatency);
+	std::printf("max latency %.2f ms at %.0f Hz, bound %.2f ms\n",
+		state->maxLatency * 1000.0 / sampleRate, sampleRate, SHARED_MAX_LATENCY * 1000.0 / sampleRate);
+
+	if(state->torn || state->reordered) {
+		std::printf("FAILED: frames arrived torn or out of order\n");
+		ret = 1;
+	}
+	if(state->lost != state->skipped + state->dropped) {
+		std::printf("FAILED: %lld frames went missing, %lld were skipped or dropped\n",
+			(long long) state->lost, (long long) (state->skipped + state->dropped));
+		ret = 1;
+	}
+	if(state->maxLatency > (int64_t) SHARED_MAX_LATENCY) {
+		std::printf("FAILED: the latency went over its bound\n");
+		ret = 1;
+	}
+	// the writer flooded the ring once and paused once
+	if(readerOk && (state->skipped == 0 || state->underruns != 1)) {
+		std::printf("FAILED: the reader didn't catch up or hold frames when it had to\n");
+		ret = 1;
+	}
+	if(readerOk && state->outputChannels != SHARED_CHANNELS) {
+		std::printf("FAILED: the output has %d channels instead of %d\n", state->outputChannels, SHARED_CHANNELS);
+		ret = 1;
+	}
+
+	state->~SharedBenchState();
+	munmap(p, sizeof(SharedBenchState));
+	return ret;
+}
+
+#else
+
+int sharedBench(const BenchOptions &options) {
+	std::printf("not available on this platform\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include <thread>
+
+#include "Bench.hpp"
+
+// The same patch processed by 1, 2, 4... up to --threads engine threads.
+// PatchbayOut modules read the buffers of PatchbayIn modules processed on
+// other threads at the same time, so this is also where torn reads would
+// show up as outputs that don't match their inputs.
+int threadsBench(const BenchOptions &options) {
+	int pairs = options.getInt("pairs", 64);
+	int routes = clamp(options.getInt("routes", 8), 0, 8);
+	int channels = clamp(options.getInt("channels", 16), 1, PORT_MAX_CHANNELS);
+	int64_t frames = options.getInt("frames", 48000);
+	int maxThreads = options.getInt("threads", std::max(4, (int) std::thread::hardware_concurrency()));
+
+	std::vector<engine::Module*> modules;
+	for(int p = 0; p < pairs; p++) {
+		engine::Module *in = addModule("PatchbayIn");
+		engine::Module *out = addModule("PatchbayOut");
+		routePorts(out, in, routes, channels);
+		modules.push_back(in);
+		modules.push_back(out);
+	}
+	processFrames(modules, 1000);
+
+	std::printf("%d pairs, %d routes per module, %d channels, %lld frames, %d cores\n",
+		pairs, routes, channels, (long long) frames, (int) std::thread::hardware_concurrency());
+	std::printf("%8s %12s %12s %10s\n", "threads", "ns/frame", "ns/route", "speedup");
+
+	int ret = 0;
+	double singleNs = 0.0;
+	for(int threads = 1; threads <= maxThreads; threads *= 2) {
+		BenchTimer timer;
+		processFrames(modules, frames, threads);
+		double ns = timer.getNanoseconds() / frames;
+		if(threads == 1) singleNs = ns;
+
+		std::printf("%8d %12.1f %12.2f %9.2fx\n", threads, ns, routes ? ns / (pairs * routes) : 0.0, singleNs / ns);
+
+		for(size_t m = 0; m < modules.size(); m += 2) {
+			if(!checkRoutes(modules[m + 1], modules[m], routes, channels)) {
+				std::printf("FAILED: outputs don't match their routed inputs\n");
+				ret = 1;
+				break;
+			}
+		}
+	}
+
+	for(engine::Module *module : modules) {
+		removeModule(module);
+	}
+	collectGarbage();
+	return ret;
+}
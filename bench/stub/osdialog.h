@@ -0,0 +1,21 @@
+#pragma once
+
+// osdialog stub for bench/, no dialogs are ever shown.
+
+typedef enum {
+	OSDIALOG_OPEN,
+	OSDIALOG_OPEN_DIR,
+	OSDIALOG_SAVE
+} osdialog_file_action;
+
+typedef struct osdialog_filters osdialog_filters;
+
+inline char *osdialog_file(osdialog_file_action action, const char *dir, const char *filename, osdialog_filters *filters) {
+	return 0;
+}
+
+inline osdialog_filters *osdialog_filters_parse(const char *str) {
+	return 0;
+}
+
+inline void osdialog_filters_free(osdialog_filters *filters) {}
@@ -0,0 +1,431 @@
+#include <cstdarg>
+#include <random>
+
+#include <rack.hpp>
+
+// JSON values own their children, json_*_new() hand a value over to its
+// parent and json_decref() frees a whole tree. That's all the plugin needs,
+// values are never shared.
+struct json_t {
+	enum Type {
+		OBJECT,
+		ARRAY,
+		STRING,
+		INTEGER,
+		REAL,
+		TRUE,
+		FALSE,
+		NUL
+	};
+	Type type;
+	std::string string;
+	long long integer = 0;
+	double real = 0.0;
+	// object members keep their insertion order, like in jansson
+	std::vector<std::pair<std::string, json_t*>> members;
+	std::vector<json_t*> items;
+
+	json_t(Type type) : type(type) {}
+	~json_t() {
+		for(auto &member : members) delete member.second;
+		for(json_t *item : items) delete item;
+	}
+};
+
+json_t *json_object() {
+	return new json_t(json_t::OBJECT);
+}
+
+json_t *json_array() {
+	return new json_t(json_t::ARRAY);
+}
+
+json_t *json_string(const char *value) {
+	json_t *json = new json_t(json_t::STRING);
+	json->string = value;
+	return json;
+}
+
+json_t *json_integer(long long value) {
+	json_t *json = new json_t(json_t::INTEGER);
+	json->integer = value;
+	return json;
+}
+
+json_t *json_real(double value) {
+	json_t *json = new json_t(json_t::REAL);
+	json->real = value;
+	return json;
+}
+
+json_t *json_boolean(bool value) {
+	return new json_t(value ? json_t::TRUE : json_t::FALSE);
+}
+
+json_t *json_true() {
+	return json_boolean(true);
+}
+
+json_t *json_false() {
+	return json_boolean(false);
+}
+
+int json_object_set_new(json_t *object, const char *key, json_t *value) {
+	if(!object || object->type != json_t::OBJECT) {
+		delete value;
+		return -1;
+	}
+	for(auto &member : object->members) {
+		if(member.first == key) {
+			delete member.second;
+			member.second = value;
+			return 0;
+		}
+	}
+	object->members.push_back(std::make_pair(std::string(key), value));
+	return 0;
+}
+
+json_t *json_object_get(const json_t *object, const char *key) {
+	if(!object || object->type != json_t::OBJECT) return NULL;
+	for(auto &member : object->members) {
+		if(member.first == key) return member.second;
+	}
+	return NULL;
+}
+
+int json_object_del(json_t *object, const char *key) {
+	if(!object || object->type != json_t::OBJECT) return -1;
+	for(auto it = object->members.begin(); it != object->members.end(); ++it) {
+		if(it->first == key) {
+			delete it->second;
+			object->members.erase(it);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int json_array_append_new(json_t *array, json_t *value) {
+	if(!array || array->type != json_t::ARRAY) {
+		delete value;
+		return -1;
+	}
+	array->items.push_back(value);
+	return 0;
+}
+
+size_t json_array_size(const json_t *array) {
+	return array && array->type == json_t::ARRAY ? array->items.size() : 0;
+}
+
+json_t *json_array_get(const json_t *array, size_t index) {
+	return index < json_array_size(array) ? array->items[index] : NULL;
+}
+
+bool json_is_string(const json_t *json) {
+	return json && json->type == json_t::STRING;
+}
+
+bool json_is_integer(const json_t *json) {
+	return json && json->type == json_t::INTEGER;
+}
+
+bool json_is_array(const json_t *json) {
+	return json && json->type == json_t::ARRAY;
+}
+
+bool json_is_object(const json_t *json) {
+	return json && json->type == json_t::OBJECT;
+}
+
+bool json_is_true(const json_t *json) {
+	return json && json->type == json_t::TRUE;
+}
+
+bool json_is_boolean(const json_t *json) {
+	return json && (json->type == json_t::TRUE || json->type == json_t::FALSE);
+}
+
+const char *json_string_value(const json_t *json) {
+	return json_is_string(json) ? json->string.c_str() : NULL;
+}
+
+long long json_integer_value(const json_t *json) {
+	return json_is_integer(json) ? json->integer : 0;
+}
+
+double json_number_value(const json_t *json) {
+	if(!json) return 0.0;
+	if(json->type == json_t::INTEGER) return json->integer;
+	if(json->type == json_t::REAL) return json->real;
+	return 0.0;
+}
+
+void json_decref(json_t *json) {
+	delete json;
+}
+
+static void dumpString(const std::string &s, std::string &out) {
+	out += '"';
+	for(char c : s) {
+		if(c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if((unsigned char) c < 0x20) {
+			out += string::f("\\u%04x", c);
+		} else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+static void dump(const json_t *json, std::string &out) {
+	switch(json->type) {
+		case json_t::OBJECT:
+			out += '{';
+			for(size_t i = 0; i < json->members.size(); i++) {
+				if(i > 0) out += ',';
+				dumpString(json->members[i].first, out);
+				out += ':';
+				dump(json->members[i].second, out);
+			}
+			out += '}';
+			break;
+		case json_t::ARRAY:
+			out += '[';
+			for(size_t i = 0; i < json->items.size(); i++) {
+				if(i > 0) out += ',';
+				dump(json->items[i], out);
+			}
+			out += ']';
+			break;
+		case json_t::STRING:
+			dumpString(json->string, out);
+			break;
+		case json_t::INTEGER:
+			out += std::to_string(json->integer);
+			break;
+		case json_t::REAL:
+			out += string::f("%.17g", json->real);
+			break;
+		case json_t::TRUE:
+			out += "true";
+			break;
+		case json_t::FALSE:
+			out += "false";
+			break;
+		case json_t::NUL:
+			out += "null";
+			break;
+	}
+}
+
+char *json_dumps(const json_t *json, size_t flags) {
+	std::string out;
+	dump(json, out);
+	return strdup(out.c_str());
+}
+
+int json_dumpf(const json_t *json, FILE *file, size_t flags) {
+	char *s = json_dumps(json, flags);
+	int ret = std::fputs(s, file) < 0 ? -1 : 0;
+	std::free(s);
+	return ret;
+}
+
+// Recursive descent over the output of json_dumps(), plus whitespace.
+struct Parser {
+	const char *p;
+
+	void skip() {
+		while(*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') p++;
+	}
+
+	bool parseString(std::string &s) {
+		if(*p != '"') return false;
+		p++;
+		while(*p && *p != '"') {
+			if(*p == '\\') {
+				p++;
+				if(*p == 'u') {
+					s += (char) std::strtol(std::string(p + 1, 4).c_str(), NULL, 16);
+					p += 5;
+					continue;
+				}
+				s += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+			} else {
+				s += *p;
+			}
+			p++;
+		}
+		if(*p != '"') return false;
+		p++;
+		return true;
+	}
+
+	json_t *parse() {
+		skip();
+		if(*p == '{') {
+			p++;
+			json_t *object = json_object();
+			skip();
+			if(*p == '}') {
+				p++;
+				return object;
+			}
+			while(true) {
+				skip();
+				std::string key;
+				if(!parseString(key)) break;
+				skip();
+				if(*p++ != ':') break;
+				json_t *value = parse();
+				if(!value) break;
+				json_object_set_new(object, key.c_str(), value);
+				skip();
+				if(*p == ',') {
+					p++;
+				} else if(*p == '}') {
+					p++;
+					return object;
+				} else {
+					break;
+				}
+			}
+			delete object;
+			return NULL;
+		}
+		if(*p == '[') {
+			p++;
+			json_t *array = json_array();
+			skip();
+			if(*p == ']') {
+				p++;
+				return array;
+			}
+			while(true) {
+				json_t *value = parse();
+				if(!value) break;
+				json_array_append_new(array, value);
+				skip();
+				if(*p == ',') {
+					p++;
+				} else if(*p == ']') {
+					p++;
+					return array;
+				} else {
+					break;
+				}
+			}
+			delete array;
+			return NULL;
+		}
+		if(*p == '"') {
+			json_t *json = new json_t(json_t::STRING);
+			if(parseString(json->string)) return json;
+			delete json;
+			return NULL;
+		}
+		if(!std::strncmp(p, "true", 4)) {
+			p += 4;
+			return json_true();
+		}
+		if(!std::strncmp(p, "false", 5)) {
+			p += 5;
+			return json_false();
+		}
+		if(!std::strncmp(p, "null", 4)) {
+			p += 4;
+			return new json_t(json_t::NUL);
+		}
+		const char *start = p;
+		char *end;
+		double real = std::strtod(p, &end);
+		if(end == start) return NULL;
+		p = end;
+		std::string number(start, (const char*) end);
+		if(number.find_first_of(".eE") == std::string::npos) {
+			return json_integer(std::strtoll(start, NULL, 10));
+		}
+		return json_real(real);
+	}
+};
+
+json_t *json_loads(const char *input, size_t flags, void *error) {
+	Parser parser;
+	parser.p = input;
+	json_t *json = parser.parse();
+	parser.skip();
+	if(json && *parser.p) {
+		delete json;
+		return NULL;
+	}
+	return json;
+}
+
+namespace rack {
+
+namespace string {
+std::string f(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	int size = std::vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	std::string s(size, '\0');
+	std::vsnprintf(&s[0], size + 1, format, argsCopy);
+	va_end(argsCopy);
+	return s;
+}
+}
+
+namespace logger {
+void log(int level, const char *filename, int line, const char *func, const char *format, ...) {
+	if(level < 2) return;
+	va_list args;
+	va_start(args, format);
+	std::fprintf(stderr, "[%s:%d %s] ", filename, line, func);
+	std::vfprintf(stderr, format, args);
+	std::fprintf(stderr, "\n");
+	va_end(args);
+}
+}
+
+namespace random {
+static std::mt19937_64 &getGenerator() {
+	static std::mt19937_64 generator(std::random_device{}());
+	return generator;
+}
+uint32_t u32() {
+	return getGenerator()() >> 32;
+}
+uint64_t u64() {
+	return getGenerator()();
+}
+float uniform() {
+	return (u32() >> 8) / 16777216.f;
+}
+}
+
+namespace settings {
+bool tooltips = true;
+}
+
+Context *contextGet() {
+	static engine::Engine engine;
+	static window::Window window;
+	static event::State event;
+	static Context context;
+	if(!context.engine) {
+		context.engine = &engine;
+		context.window = &window;
+		context.event = &event;
+	}
+	return &context;
+}
+
+}
@@ -0,0 +1,886 @@
+#pragma once
+
+// Just enough of the Rack v2 SDK to build the plugin sources outside of Rack,
+// for the benchmarks and tests in bench/. The engine types behave like the
+// real ones as far as the plugin relies on them: ports, module config and
+// events, frames, adding and removing modules. Widgets and drawing compile
+// but do nothing. JSON is a small subset of jansson, see rack.cpp.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <xmmintrin.h>
+
+#if defined(__linux__)
+#define ARCH_LIN 1
+#elif defined(__APPLE__)
+#define ARCH_MAC 1
+#else
+#define ARCH_WIN 1
+#endif
+
+// jansson
+struct json_t;
+json_t *json_object();
+json_t *json_array();
+json_t *json_string(const char *value);
+json_t *json_integer(long long value);
+json_t *json_real(double value);
+json_t *json_boolean(bool value);
+json_t *json_true();
+json_t *json_false();
+int json_object_set_new(json_t *object, const char *key, json_t *value);
+json_t *json_object_get(const json_t *object, const char *key);
+int json_object_del(json_t *object, const char *key);
+int json_array_append_new(json_t *array, json_t *value);
+size_t json_array_size(const json_t *array);
+json_t *json_array_get(const json_t *array, size_t index);
+bool json_is_string(const json_t *json);
+bool json_is_integer(const json_t *json);
+bool json_is_array(const json_t *json);
+bool json_is_object(const json_t *json);
+bool json_is_true(const json_t *json);
+bool json_is_boolean(const json_t *json);
+const char *json_string_value(const json_t *json);
+long long json_integer_value(const json_t *json);
+double json_number_value(const json_t *json);
+void json_decref(json_t *json);
+// compact output, the flags are ignored
+char *json_dumps(const json_t *json, size_t flags);
+int json_dumpf(const json_t *json, FILE *file, size_t flags);
+// NULL on a syntax error, error is ignored
+json_t *json_loads(const char *input, size_t flags, void *error);
+#define JSON_INDENT(n) (n)
+
+// nanovg
+struct NVGcolor {
+	float r, g, b, a;
+};
+struct NVGcontext;
+struct NVGglyphPosition {
+	const char *str;
+	float x, minx, maxx;
+};
+inline NVGcolor nvgRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+	NVGcolor c = {r / 255.f, g / 255.f, b / 255.f, a / 255.f};
+	return c;
+}
+inline NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b) {
+	return nvgRGBA(r, g, b, 255);
+}
+inline void nvgScissor(NVGcontext *, float, float, float, float) {}
+inline void nvgResetScissor(NVGcontext *) {}
+inline void nvgBeginPath(NVGcontext *) {}
+inline void nvgRoundedRect(NVGcontext *, float, float, float, float, float) {}
+inline void nvgRect(NVGcontext *, float, float, float, float) {}
+inline void nvgFillColor(NVGcontext *, NVGcolor) {}
+inline void nvgFill(NVGcontext *) {}
+inline void nvgFontFaceId(NVGcontext *, int) {}
+inline void nvgFontSize(NVGcontext *, float) {}
+inline void nvgTextLetterSpacing(NVGcontext *, float) {}
+inline void nvgTextAlign(NVGcontext *, int) {}
+inline float nvgText(NVGcontext *, float x, float, const char *, const char *) {
+	return x;
+}
+inline int nvgTextGlyphPositions(NVGcontext *, float, float, const char *, const char *, NVGglyphPosition *, int) {
+	return 0;
+}
+enum {
+	NVG_ALIGN_CENTER = 1 << 1,
+	NVG_ALIGN_TOP = 1 << 3
+};
+enum BNDwidgetState {
+	BND_DEFAULT,
+	BND_HOVER,
+	BND_ACTIVE
+};
+
+// GLFW
+#define GLFW_MOUSE_BUTTON_LEFT 0
+#define GLFW_MOUSE_BUTTON_RIGHT 1
+#define GLFW_RELEASE 0
+#define GLFW_PRESS 1
+#define GLFW_REPEAT 2
+#define GLFW_KEY_V 86
+#define GLFW_KEY_ESCAPE 256
+#define GLFW_KEY_HOME 268
+#define GLFW_KEY_END 269
+#define GLFW_MOD_SHIFT 0x0001
+#define RACK_MOD_CTRL 0x0002
+#define RACK_MOD_MASK 0x000f
+struct GLFWwindow;
+inline const char *glfwGetClipboardString(GLFWwindow *) {
+	return "";
+}
+
+namespace rack {
+
+static const int PORT_MAX_CHANNELS = 16;
+static const float RACK_GRID_WIDTH = 15;
+static const float RACK_GRID_HEIGHT = 380;
+
+namespace string {
+std::string f(const char *format, ...);
+}
+
+namespace math {
+struct Vec {
+	float x = 0.f;
+	float y = 0.f;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const {
+		return Vec(x + b.x, y + b.y);
+	}
+	Vec round() const {
+		return Vec(std::round(x), std::round(y));
+	}
+};
+struct Rect {
+	Vec pos;
+	Vec size;
+	Rect nudge(Rect) const {
+		return *this;
+	}
+	Rect zeroPos() const {
+		Rect r;
+		r.size = size;
+		return r;
+	}
+};
+inline float normalizeZero(float x) {
+	return x + 0.f;
+}
+template <typename T>
+T clamp(T x, T a, T b) {
+	return std::max(std::min(x, b), a);
+}
+}
+using namespace math;
+
+namespace simd {
+struct float_4 {
+	__m128 v;
+	float_4() {}
+	float_4(__m128 v) : v(v) {}
+	float_4(float x) : v(_mm_set1_ps(x)) {}
+	static float_4 load(const float *p) {
+		return float_4(_mm_loadu_ps(p));
+	}
+	void store(float *p) const {
+		_mm_storeu_ps(p, v);
+	}
+	static float_4 zero() {
+		return float_4(_mm_setzero_ps());
+	}
+};
+inline float_4 operator+(float_4 a, float_4 b) {
+	return _mm_add_ps(a.v, b.v);
+}
+inline float_4 operator-(float_4 a, float_4 b) {
+	return _mm_sub_ps(a.v, b.v);
+}
+inline float_4 operator*(float_4 a, float_4 b) {
+	return _mm_mul_ps(a.v, b.v);
+}
+}
+
+namespace dsp {
+struct ClockDivider {
+	uint32_t clock = 0;
+	uint32_t division = 1;
+	void reset() {
+		clock = 0;
+	}
+	void setDivision(uint32_t division) {
+		this->division = division;
+	}
+	uint32_t getDivision() {
+		return division;
+	}
+	uint32_t getClock() {
+		return clock;
+	}
+	bool process() {
+		if(++clock >= division) {
+			clock = 0;
+			return true;
+		}
+		return false;
+	}
+};
+}
+
+namespace logger {
+void log(int level, const char *filename, int line, const char *func, const char *format, ...);
+}
+#define DEBUG(format, ...) rack::logger::log(0, __FILE__, __LINE__, __FUNCTION__, format, ##__VA_ARGS__)
+#define INFO(format, ...) rack::logger::log(1, __FILE__, __LINE__, __FUNCTION__, format, ##__VA_ARGS__)
+#define WARN(format, ...) rack::logger::log(2, __FILE__, __LINE__, __FUNCTION__, format, ##__VA_ARGS__)
+
+namespace random {
+uint32_t u32();
+uint64_t u64();
+float uniform();
+}
+
+namespace plugin {
+struct Model;
+struct Plugin;
+}
+
+namespace app {
+struct ModuleWidget;
+}
+
+namespace engine {
+
+using plugin::Model;
+
+struct Port {
+	union {
+		float voltages[PORT_MAX_CHANNELS] = {};
+		float value;
+	};
+	// 0 for a disconnected port
+	uint8_t channels = 0;
+
+	enum Type {
+		INPUT,
+		OUTPUT
+	};
+
+	void setVoltage(float voltage, int channel = 0) {
+		voltages[channel] = voltage;
+	}
+	float getVoltage(int channel = 0) {
+		return voltages[channel];
+	}
+	// Like in Rack, a disconnected port stays at 0 channels and a connected
+	// one at 1 or more.
+	void setChannels(int channels) {
+		if(this->channels == 0) return;
+		for(int c = channels; c < this->channels; c++) {
+			voltages[c] = 0.f;
+		}
+		if(channels == 0) channels = 1;
+		this->channels = channels;
+	}
+	int getChannels() {
+		return channels;
+	}
+	bool isConnected() {
+		return channels > 0;
+	}
+};
+
+struct Input : Port {};
+struct Output : Port {};
+
+struct Light {
+	float value = 0.f;
+	void setBrightness(float brightness) {
+		value = brightness;
+	}
+	float getBrightness() {
+		return value;
+	}
+};
+
+struct PortInfo {
+	std::string name;
+	std::string getName() {
+		return name;
+	}
+	std::string getFullName() {
+		return name;
+	}
+	std::string getDescription() {
+		return "";
+	}
+};
+
+struct Param {
+	float value = 0.f;
+};
+
+struct Module {
+	int64_t id = -1;
+	Model *model = NULL;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+
+	virtual ~Module() {}
+
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+	}
+	PortInfo *configInput(int portId, std::string name = "") {
+		return NULL;
+	}
+	PortInfo *configOutput(int portId, std::string name = "") {
+		return NULL;
+	}
+
+	struct ProcessArgs {
+		float sampleRate;
+		float sampleTime;
+		int64_t frame;
+	};
+	virtual void process(const ProcessArgs &args) {}
+	virtual void processBypass(const ProcessArgs &args) {}
+
+	// set by Engine::bypassModule(), the engine calls processBypass() instead
+	bool bypassed = false;
+	bool isBypassed() {
+		return bypassed;
+	}
+
+	virtual json_t *dataToJson() {
+		return NULL;
+	}
+	virtual void dataFromJson(json_t *root) {}
+
+	struct AddEvent {};
+	struct RemoveEvent {};
+	struct PortChangeEvent {
+		bool connecting;
+		Port::Type type;
+		int portId;
+	};
+	struct SampleRateChangeEvent {
+		float sampleRate;
+		float sampleTime;
+	};
+	virtual void onAdd(const AddEvent &e) {}
+	virtual void onRemove(const RemoveEvent &e) {}
+	virtual void onPortChange(const PortChangeEvent &e) {}
+	virtual void onSampleRateChange(const SampleRateChangeEvent &e) {}
+};
+
+struct Cable {
+	int64_t id = -1;
+	Module *inputModule = NULL;
+	int inputId = 0;
+	Module *outputModule = NULL;
+	int outputId = 0;
+};
+
+// Only keeps track of modules and the frame counter. The benchmarks call
+// process() themselves, stepFrame() moves on to the next frame.
+struct Engine {
+	std::map<int64_t, Module*> modules;
+	int64_t nextId = 1;
+	std::atomic<int64_t> frame;
+	float sampleRate = 48000.f;
+
+	Engine() : frame(0) {}
+
+	int64_t getFrame() {
+		return frame.load(std::memory_order_relaxed);
+	}
+	void stepFrame() {
+		frame.fetch_add(1, std::memory_order_relaxed);
+	}
+	float getSampleRate() {
+		return sampleRate;
+	}
+	int getNumThreads() {
+		return 1;
+	}
+
+	// Like Engine::addModule(), sets the id and sends AddEvent.
+	void addModule(Module *module) {
+		if(module->id < 0) module->id = nextId++;
+		modules[module->id] = module;
+		Module::AddEvent e;
+		module->onAdd(e);
+	}
+	void removeModule(Module *module) {
+		Module::RemoveEvent e;
+		module->onRemove(e);
+		modules.erase(module->id);
+	}
+	Module *getModule(int64_t id) {
+		auto it = modules.find(id);
+		return it == modules.end() ? NULL : it->second;
+	}
+	void bypassModule(Module *module, bool bypassed) {
+		module->bypassed = bypassed;
+	}
+	// Connect or disconnect an output as a cable would.
+	void setOutputConnected(Module *module, int portId, bool connected) {
+		module->outputs[portId].channels = connected ? 1 : 0;
+		Module::PortChangeEvent e;
+		e.connecting = connected;
+		e.type = Port::OUTPUT;
+		e.portId = portId;
+		module->onPortChange(e);
+	}
+	void setInputConnected(Module *module, int portId, int channels) {
+		module->inputs[portId].channels = channels;
+		Module::PortChangeEvent e;
+		e.connecting = channels > 0;
+		e.type = Port::INPUT;
+		e.portId = portId;
+		module->onPortChange(e);
+	}
+};
+
+}
+
+namespace plugin {
+struct Model {
+	Plugin *plugin = NULL;
+	std::string slug;
+	std::string name;
+
+	virtual ~Model() {}
+	virtual engine::Module *createModule() {
+		return NULL;
+	}
+	virtual app::ModuleWidget *createModuleWidget(engine::Module *m) {
+		return NULL;
+	}
+	std::string getFullName() {
+		return name;
+	}
+};
+
+struct Plugin {
+	std::vector<Model*> models;
+	void addModel(Model *model) {
+		model->plugin = this;
+		models.push_back(model);
+	}
+	Model *getModel(const std::string &slug) {
+		for(Model *model : models) {
+			if(model->slug == slug) return model;
+		}
+		return NULL;
+	}
+};
+}
+using plugin::Model;
+using plugin::Plugin;
+
+namespace asset {
+inline std::string plugin(Plugin *plugin, const std::string &filename) {
+	return filename;
+}
+inline std::string system(const std::string &filename) {
+	return filename;
+}
+}
+
+namespace window {
+struct Font {
+	int handle = -1;
+};
+struct Svg {};
+struct Window {
+	GLFWwindow *win = NULL;
+	std::shared_ptr<Font> loadFont(const std::string &filename) {
+		return std::make_shared<Font>();
+	}
+	std::shared_ptr<Svg> loadSvg(const std::string &filename) {
+		return std::make_shared<Svg>();
+	}
+};
+}
+using window::Font;
+using window::Svg;
+
+namespace widget {
+struct Widget;
+
+struct BaseEvent {
+	mutable Widget *consumed = NULL;
+	void consume(Widget *w) const {
+		consumed = w;
+	}
+	bool isConsumed() const {
+		return consumed != NULL;
+	}
+};
+
+struct Widget {
+	Rect box;
+	Widget *parent = NULL;
+	std::list<Widget*> children;
+	bool visible = true;
+
+	struct DrawArgs {
+		NVGcontext *vg = NULL;
+		Rect clipBox;
+	};
+	struct HoverEvent : BaseEvent {
+		Vec pos, mouseDelta;
+	};
+	struct EnterEvent : BaseEvent {};
+	struct LeaveEvent : BaseEvent {};
+	struct ButtonEvent : BaseEvent {
+		Vec pos;
+		int button, action, mods;
+	};
+	struct DragHoverEvent : BaseEvent {
+		Widget *origin;
+	};
+	struct DragEnterEvent : BaseEvent {
+		Widget *origin;
+	};
+	struct DragLeaveEvent : BaseEvent {
+		Widget *origin;
+	};
+	struct DragDropEvent : BaseEvent {
+		Widget *origin;
+	};
+	struct HoverScrollEvent : BaseEvent {};
+	struct SelectEvent : BaseEvent {};
+	struct DeselectEvent : BaseEvent {};
+	struct SelectKeyEvent : BaseEvent {
+		int key, scancode, action, mods;
+	};
+	struct SelectTextEvent : BaseEvent {
+		int codepoint;
+	};
+	struct ActionEvent : BaseEvent {};
+	struct ChangeEvent : BaseEvent {};
+
+	virtual ~Widget() {
+		clearChildren();
+	}
+
+	virtual void step() {
+		for(Widget *child : children) child->step();
+	}
+	virtual void draw(const DrawArgs &args) {}
+
+	virtual void onHover(const HoverEvent &e) {}
+	virtual void onEnter(const EnterEvent &e) {}
+	virtual void onLeave(const LeaveEvent &e) {}
+	virtual void onButton(const ButtonEvent &e) {}
+	virtual void onDragHover(const DragHoverEvent &e) {}
+	virtual void onDragEnter(const DragEnterEvent &e) {}
+	virtual void onDragLeave(const DragLeaveEvent &e) {}
+	virtual void onDragDrop(const DragDropEvent &e) {}
+	virtual void onHoverScroll(const HoverScrollEvent &e) {}
+	virtual void onSelect(const SelectEvent &e) {}
+	virtual void onDeselect(const DeselectEvent &e) {}
+	virtual void onSelectKey(const SelectKeyEvent &e) {}
+	virtual void onSelectText(const SelectTextEvent &e) {}
+	virtual void onAction(const ActionEvent &e) {}
+	virtual void onChange(const ChangeEvent &e) {}
+
+	void addChild(Widget *child) {
+		child->parent = this;
+		children.push_back(child);
+	}
+	void addChildBottom(Widget *child) {
+		child->parent = this;
+		children.push_front(child);
+	}
+	void removeChild(Widget *child) {
+		children.remove(child);
+		child->parent = NULL;
+	}
+	void clearChildren() {
+		for(Widget *child : children) delete child;
+		children.clear();
+	}
+	Vec getAbsoluteOffset(Vec v) {
+		return v;
+	}
+	template <class T>
+	T *getAncestorOfType() {
+		for(Widget *w = parent; w; w = w->parent) {
+			T *t = dynamic_cast<T*>(w);
+			if(t) return t;
+		}
+		return NULL;
+	}
+	void requestDelete() {}
+};
+
+struct TransparentWidget : Widget {};
+struct OpaqueWidget : Widget {};
+struct FramebufferWidget : Widget {
+	bool dirty = true;
+	void setDirty(bool dirty = true) {
+		this->dirty = dirty;
+	}
+};
+}
+
+namespace event {
+using namespace widget;
+typedef Widget::ActionEvent Action;
+typedef Widget::ChangeEvent Change;
+typedef Widget::ButtonEvent Button;
+typedef Widget::HoverEvent Hover;
+typedef Widget::EnterEvent Enter;
+typedef Widget::LeaveEvent Leave;
+typedef Widget::DragHoverEvent DragHover;
+typedef Widget::HoverScrollEvent HoverScroll;
+typedef Widget::SelectEvent Select;
+typedef Widget::DeselectEvent Deselect;
+typedef Widget::SelectKeyEvent SelectKey;
+typedef Widget::SelectTextEvent SelectText;
+struct State {
+	Widget *selectedWidget = NULL;
+	void setSelectedWidget(Widget *w) {
+		selectedWidget = w;
+	}
+};
+}
+
+namespace ui {
+using namespace widget;
+struct TextField : OpaqueWidget {
+	std::string text;
+	std::string placeholder;
+	int cursor = 0;
+	int selection = 0;
+	bool multiline = false;
+	void setText(std::string text) {
+		this->text = text;
+		cursor = selection = text.size();
+	}
+	std::string getText() {
+		return text;
+	}
+	void insertText(std::string s) {
+		text.insert(std::min(cursor, selection), s);
+	}
+	void selectAll() {}
+};
+struct Tooltip : Widget {
+	std::string text;
+};
+struct MenuEntry : OpaqueWidget {};
+struct MenuLabel : MenuEntry {
+	std::string text;
+};
+struct MenuSeparator : MenuEntry {};
+struct Menu;
+struct MenuItem : MenuEntry {
+	std::string text;
+	std::string rightText;
+	bool disabled = false;
+	virtual Menu *createChildMenu() {
+		return NULL;
+	}
+};
+struct Menu : OpaqueWidget {
+	Menu *parentMenu = NULL;
+	Menu *childMenu = NULL;
+	MenuEntry *activeEntry = NULL;
+	// like Rack, the previous child menu is deleted
+	void setChildMenu(Menu *menu) {
+		if(childMenu) {
+			if(childMenu->parent) childMenu->parent->removeChild(childMenu);
+			delete childMenu;
+			childMenu = NULL;
+		}
+		if(menu) {
+			childMenu = menu;
+			if(parent) parent->addChild(menu);
+		}
+	}
+};
+struct MenuOverlay : OpaqueWidget {};
+inline Menu *createMenu() {
+	return new Menu;
+}
+}
+using namespace ui;
+
+namespace app {
+using namespace widget;
+struct PortWidget : OpaqueWidget {
+	engine::Module *module = NULL;
+	int portId = 0;
+	engine::Port::Type type = engine::Port::INPUT;
+	engine::Port *getPort() {
+		return NULL;
+	}
+	engine::PortInfo *getPortInfo() {
+		static engine::PortInfo info;
+		return &info;
+	}
+};
+struct SvgPort : PortWidget {};
+struct PJ301MPort : SvgPort {};
+struct CableWidget : OpaqueWidget {
+	PortWidget *inputPort = NULL;
+	PortWidget *outputPort = NULL;
+};
+struct ModuleWidget : OpaqueWidget {
+	Model *model = NULL;
+	engine::Module *module = NULL;
+	void setModule(engine::Module *module) {
+		this->module = module;
+	}
+	void setPanel(std::shared_ptr<Svg> svg) {}
+	void addInput(PortWidget *w) {
+		addChild(w);
+	}
+	void addOutput(PortWidget *w) {
+		addChild(w);
+	}
+	PortWidget *getInput(int portId) {
+		return NULL;
+	}
+	PortWidget *getOutput(int portId) {
+		return NULL;
+	}
+	virtual void appendContextMenu(Menu *menu) {}
+};
+struct RackWidget : OpaqueWidget {
+	ModuleWidget *getModule(int64_t moduleId) {
+		return NULL;
+	}
+	std::vector<CableWidget*> getCompleteCablesOnPort(PortWidget *port) {
+		return std::vector<CableWidget*>();
+	}
+};
+struct Scene : OpaqueWidget {
+	RackWidget *rack = NULL;
+};
+struct SvgPanel : Widget {
+	void setBackground(std::shared_ptr<Svg> svg) {}
+};
+struct ModuleLightWidget : Widget {};
+template <typename TBase>
+struct TinyLight : TBase {};
+struct GreenRedLight : ModuleLightWidget {};
+}
+using namespace app;
+using namespace engine;
+
+namespace settings {
+extern bool tooltips;
+}
+
+struct Context {
+	engine::Engine *engine = NULL;
+	app::Scene *scene = NULL;
+	window::Window *window = NULL;
+	event::State *event = NULL;
+};
+Context *contextGet();
+#define APP rack::contextGet()
+
+template <class TWidget>
+TWidget *createWidget(Vec pos) {
+	TWidget *w = new TWidget;
+	w->box.pos = pos;
+	return w;
+}
+template <class TWidget>
+TWidget *createLightCentered(Vec pos, engine::Module *module, int firstLightId) {
+	return createWidget<TWidget>(pos);
+}
+template <class TPort>
+TPort *createInputCentered(Vec pos, engine::Module *module, int portId) {
+	TPort *w = createWidget<TPort>(pos);
+	w->module = module;
+	w->portId = portId;
+	return w;
+}
+template <class TPort>
+TPort *createOutputCentered(Vec pos, engine::Module *module, int portId) {
+	TPort *w = createInputCentered<TPort>(pos, module, portId);
+	w->type = engine::Port::OUTPUT;
+	return w;
+}
+
+template <class TMenuLabel = ui::MenuLabel>
+TMenuLabel *createMenuLabel(std::string text) {
+	TMenuLabel *o = new TMenuLabel;
+	o->text = text;
+	return o;
+}
+template <class TMenuItem = ui::MenuItem>
+TMenuItem *createMenuItem(std::string text, std::string rightText = "") {
+	TMenuItem *o = new TMenuItem;
+	o->text = text;
+	o->rightText = rightText;
+	return o;
+}
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem *createMenuItem(std::string text, std::string rightText, std::function<void()> action, bool disabled = false, bool alwaysConsume = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem *createBoolMenuItem(std::string text, std::string rightText, std::function<bool()> getter, std::function<void(bool)> setter, bool disabled = false, bool alwaysConsume = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem *createBoolPtrMenuItem(std::string text, std::string rightText, bool *ptr) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem *createSubmenuItem(std::string text, std::string rightText, std::function<void(ui::Menu *menu)> createMenu, bool disabled = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem *createIndexSubmenuItem(std::string text, std::vector<std::string> labels, std::function<size_t()> getter, std::function<void(size_t)> setter, bool disabled = false, bool alwaysConsume = false) {
+	return createMenuItem<TMenuItem>(text);
+}
+
+template <class T, typename F, typename V>
+T *construct(F f, V v) {
+	T *o = new T;
+	o->*f = v;
+	return o;
+}
+
+#define CHECKMARK_STRING "✔"
+#define CHECKMARK(cond) ((cond) ? CHECKMARK_STRING : "")
+
+template <class TModule, class TModuleWidget>
+plugin::Model *createModel(std::string slug) {
+	struct TModel : plugin::Model {
+		engine::Module *createModule() override {
+			engine::Module *m = new TModule;
+			m->model = this;
+			return m;
+		}
+		app::ModuleWidget *createModuleWidget(engine::Module *m) override {
+			TModule *tm = dynamic_cast<TModule*>(m);
+			app::ModuleWidget *mw = new TModuleWidget(tm);
+			mw->model = this;
+			return mw;
+		}
+	};
+
+	plugin::Model *o = new TModel;
+	o->slug = slug;
+	o->name = slug;
+	return o;
+}
+
+}
+
+using namespace rack;
+
+// defined by the plugin
+void init(rack::plugin::Plugin *p);
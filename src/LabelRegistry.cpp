@@ -0,0 +1,309 @@
+#include <algorithm>
+
+#include "LabelRegistry.hpp"
+#include "Patchbay.hpp"
+
+static const char labelCharset[] =
+	"0123456789"
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz";
+static const uint64_t labelCharsetSize = sizeof(labelCharset) - 1;
+
+LabelRegistry::LabelRegistry() {
+	names.push_back("");
+	hashes.push_back(hash(""));
+	sources.push_back(Source());
+	subscribers.emplace_back();
+	refs.push_back(0);
+	table.assign(64, NO_LABEL);
+}
+
+// FNV-1a, plenty for labels of a few characters
+uint32_t LabelRegistry::hash(const std::string &lbl) {
+	uint32_t h = 2166136261u;
+	for(char c : lbl) {
+		h ^= (uint8_t) c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+LabelHandle LabelRegistry::find(const std::string &lbl) const {
+	if(lbl.empty()) return NO_LABEL;
+
+	uint32_t h = hash(lbl);
+	size_t mask = table.size() - 1;
+	for(size_t i = h & mask; table[i] != NO_LABEL; i = (i + 1) & mask) {
+		LabelHandle candidate = table[i];
+		if(hashes[candidate] == h && names[candidate] == lbl) {
+			return candidate;
+		}
+	}
+
+	return NO_LABEL;
+}
+
+LabelHandle LabelRegistry::intern(const std::string &lbl) {
+	if(lbl.empty()) return NO_LABEL;
+
+	uint32_t h = hash(lbl);
+	size_t mask = table.size() - 1;
+	size_t i = h & mask;
+	for(; table[i] != NO_LABEL; i = (i + 1) & mask) {
+		LabelHandle candidate = table[i];
+		if(hashes[candidate] == h && names[candidate] == lbl) {
+			return candidate;
+		}
+	}
+
+	LabelHandle handle;
+	if(!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		names[handle] = lbl;
+		hashes[handle] = h;
+	} else {
+		handle = names.size();
+		names.push_back(lbl);
+		hashes.push_back(h);
+		sources.push_back(Source());
+		subscribers.emplace_back();
+		refs.push_back(0);
+	}
+	table[i] = handle;
+
+	// keep the load factor at or below 1/2 so probe sequences stay short
+	if(2 * size() > table.size()) {
+		grow();
+	}
+
+	return handle;
+}
+
+// Generated labels are a counter run through a linear congruential generator
+// modulo 62^length. With the multiplier - 1 divisible by 4 and 31 (the prime
+// factors of 62^n, n >= 2) and an increment coprime to 62, the LCG visits every
+// value exactly once per period, so labels look random but never repeat and
+// no retry loop over the registry is needed. Only labels typed by the user or
+// loaded from a patch can collide, those are skipped.
+LabelHandle LabelRegistry::generate() {
+	if(lcgModulus == 0) {
+		// seeded from Rack's PRNG, which is independent of libc rand()
+		lcgMultiplier = 1 + 124 * (1 + random::u32() % 100000);
+		do {
+			lcgIncrement = random::u32() | 1;
+		} while(lcgIncrement % 31 == 0);
+
+		lcgModulus = 1;
+		for(size_t i = 0; i < generatedLength; i++) {
+			lcgModulus *= labelCharsetSize;
+		}
+		lcgRemaining = lcgModulus;
+		lcgState = random::u64() % lcgModulus;
+	}
+
+	while(true) {
+		if(lcgRemaining == 0) {
+			// every label of this length was handed out, move on to longer ones
+			generatedLength++;
+			lcgModulus *= labelCharsetSize;
+			lcgRemaining = lcgModulus;
+		}
+
+		lcgState = (lcgMultiplier * lcgState + lcgIncrement) % lcgModulus;
+		lcgRemaining--;
+
+		std::string lbl(generatedLength, '0');
+		uint64_t x = lcgState;
+		for(size_t i = 0; i < generatedLength; i++) {
+			lbl[i] = labelCharset[x % labelCharsetSize];
+			x /= labelCharsetSize;
+		}
+
+		if(find(lbl) == NO_LABEL) {
+			return intern(lbl);
+		}
+	}
+}
+
+void LabelRegistry::subscribe(LabelHandle h, Patchbay *module, int port) {
+	if(h == NO_LABEL) return;
+
+	Subscriber sub;
+	sub.module = module;
+	sub.port = port;
+	subscribers[h].push_back(sub);
+}
+
+void LabelRegistry::unsubscribe(LabelHandle h, Patchbay *module, int port) {
+	std::vector<Subscriber> &subs = subscribers[h];
+
+	for(size_t i = 0; i < subs.size(); i++) {
+		if(subs[i].module == module && subs[i].port == port) {
+			// order doesn't matter, swap with the last one
+			subs[i] = subs.back();
+			subs.pop_back();
+			return;
+		}
+	}
+}
+
+void LabelRegistry::addModule(std::vector<Patchbay*> &modules, Patchbay *module) {
+	if(module->registryIdx >= 0) return;
+
+	module->registryIdx = modules.size();
+	modules.push_back(module);
+}
+
+void LabelRegistry::removeModule(std::vector<Patchbay*> &modules, Patchbay *module) {
+	int idx = module->registryIdx;
+	if(idx < 0) return;
+
+	// move the last entry into the hole
+	Patchbay *last = modules.back();
+	modules[idx] = last;
+	last->registryIdx = idx;
+	modules.pop_back();
+
+	module->registryIdx = -1;
+}
+
+// Only compares pointers, so it's safe to call with a module that may have
+// been deleted since it was last seen, e.g. by a menu.
+bool LabelRegistry::hasSourceModule(Patchbay *module) const {
+	return std::find(sourceModules.begin(), sourceModules.end(), module) != sourceModules.end();
+}
+
+const std::vector<LabelHandle> &LabelRegistry::getSortedSources() {
+	if(sortedVersion != sourceVersion) {
+		sortedSources.clear();
+		for(LabelHandle h = 1; h < names.size(); h++) {
+			if(hasSource(h)) {
+				sortedSources.push_back(h);
+			}
+		}
+		std::sort(sortedSources.begin(), sortedSources.end(), [&](LabelHandle a, LabelHandle b) {
+			return names[a] < names[b];
+		});
+		sortedVersion = sourceVersion;
+	}
+	return sortedSources;
+}
+
+void LabelRegistry::findSourcesByPrefix(const std::string &prefix, size_t *begin, size_t *end) {
+	const std::vector<LabelHandle> &sorted = getSortedSources();
+	size_t n = prefix.size();
+
+	// names are compared truncated to the length of the prefix, all the ones
+	// starting with it compare equal and are next to each other
+	auto first = std::lower_bound(sorted.begin(), sorted.end(), prefix, [&](LabelHandle h, const std::string &p) {
+		return names[h].compare(0, n, p) < 0;
+	});
+	auto last = std::upper_bound(first, sorted.end(), prefix, [&](const std::string &p, LabelHandle h) {
+		return names[h].compare(0, n, p) > 0;
+	});
+
+	*begin = first - sorted.begin();
+	*end = last - sorted.begin();
+}
+
+static json_t *portToJson(Patchbay *module, int port) {
+	json_t *data = json_object();
+	json_object_set_new(data, "module", json_integer(module->id));
+	json_object_set_new(data, "port", json_integer(port));
+	return data;
+}
+
+static json_t *modulesToJson(const std::vector<Patchbay*> &modules) {
+	json_t *data = json_array();
+
+	for(Patchbay *module : modules) {
+		json_t *module_json = json_object();
+		json_object_set_new(module_json, "id", json_integer(module->id));
+		json_object_set_new(module_json, "model", json_string(module->model ? module->model->slug.c_str() : ""));
+
+		PatchbayCounterList counters;
+		module->getCounters(counters);
+		json_t *counters_json = json_object();
+		for(auto &counter : counters) {
+			json_object_set_new(counters_json, counter.first.c_str(), json_integer(counter.second));
+		}
+		json_object_set_new(module_json, "counters", counters_json);
+
+		json_array_append_new(data, module_json);
+	}
+
+	return data;
+}
+
+json_t *LabelRegistry::toJson() {
+	json_t *labels = json_array();
+
+	for(LabelHandle h = 1; h < names.size(); h++) {
+		if(names[h].empty()) continue;
+		json_t *label_json = json_object();
+		json_object_set_new(label_json, "handle", json_integer(h));
+		json_object_set_new(label_json, "name", json_string(names[h].c_str()));
+		json_object_set_new(label_json, "refs", json_integer(refs[h]));
+		if(sources[h].module) {
+			json_object_set_new(label_json, "source", portToJson(sources[h].module, sources[h].port));
+		}
+
+		json_t *subs = json_array();
+		for(const Subscriber &sub : subscribers[h]) {
+			json_array_append_new(subs, portToJson(sub.module, sub.port));
+		}
+		json_object_set_new(label_json, "subscribers", subs);
+
+		json_array_append_new(labels, label_json);
+	}
+
+	json_t *data = json_object();
+	json_object_set_new(data, "labels", labels);
+	json_object_set_new(data, "sources", modulesToJson(sourceModules));
+	json_object_set_new(data, "destinations", modulesToJson(destinations));
+	json_object_set_new(data, "freeHandles", json_integer(freeHandles.size()));
+	json_object_set_new(data, "tableSize", json_integer(table.size()));
+	return data;
+}
+
+void LabelRegistry::grow() {
+	table.assign(2 * table.size(), NO_LABEL);
+	size_t mask = table.size() - 1;
+
+	for(LabelHandle handle = 1; handle < names.size(); handle++) {
+		if(names[handle].empty()) continue;
+		size_t i = hashes[handle] & mask;
+		while(table[i] != NO_LABEL) {
+			i = (i + 1) & mask;
+		}
+		table[i] = handle;
+	}
+}
+
+// Remove h from the table with backward shift deletion: entries after it in
+// the same probe run move up into the hole if their home slot allows, so no
+// tombstones are needed and lookups stop at the first empty slot as before.
+void LabelRegistry::erase(LabelHandle h) {
+	size_t mask = table.size() - 1;
+	size_t i = hashes[h] & mask;
+	while(table[i] != h) {
+		i = (i + 1) & mask;
+	}
+
+	for(size_t j = (i + 1) & mask; table[j] != NO_LABEL; j = (j + 1) & mask) {
+		size_t home = hashes[table[j]] & mask;
+		// distance from the home slot to j, and from the hole to j
+		if(((j - home) & mask) >= ((j - i) & mask)) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+	table[i] = NO_LABEL;
+
+	// release what the label held, the slot itself is reused
+	std::string().swap(names[h]);
+	std::vector<Subscriber>().swap(subscribers[h]);
+	sources[h] = Source();
+	freeHandles.push_back(h);
+}
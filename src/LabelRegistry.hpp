@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "plugin.hpp"
+
+// Labels are interned into small integer handles when they are edited or
+// loaded. Modules store and compare handles, the strings are only needed for
+// display and serialization. Handles are reference counted by the ports
+// holding them (see Patchbay::replaceLabel()), once the last one lets go the
+// label is dropped and its handle reused for the next new label.
+typedef uint32_t LabelHandle;
+static const LabelHandle NO_LABEL = 0; // the empty label
+
+struct Patchbay;
+
+struct LabelRegistry {
+	// The endpoint currently publishing a label.
+	struct Source {
+		Patchbay *module = NULL;
+		int port = 0;
+	};
+
+	// A PatchbayOut port that has selected a label, whether or not the label
+	// currently has a source.
+	struct Subscriber {
+		Patchbay *module;
+		int port;
+	};
+
+	// Indexed by handle. Handle 0 is reserved for the empty label.
+	std::vector<std::string> names;
+	std::vector<uint32_t> hashes;
+	std::vector<Source> sources;
+	std::vector<std::vector<Subscriber>> subscribers;
+	std::vector<uint32_t> refs;
+	// Released handles, reused by intern(). Their names are empty.
+	std::vector<LabelHandle> freeHandles;
+
+	// Open addressing table (linear probing) holding handles, NO_LABEL marks
+	// an empty slot. The size is always a power of two.
+	std::vector<LabelHandle> table;
+
+	// Label generator state, see generate(). Seeded on first use.
+	uint64_t lcgState = 0;
+	uint64_t lcgMultiplier = 0;
+	uint64_t lcgIncrement = 0;
+	uint64_t lcgModulus = 0;
+	uint64_t lcgRemaining = 0;
+	size_t generatedLength = 4;
+
+	// Live PatchbayOut and PatchbayIn modules respectively, exactly one entry
+	// each. Every module keeps its own position in Patchbay::registryIdx so it
+	// can be removed in O(1).
+	std::vector<Patchbay*> destinations;
+	std::vector<Patchbay*> sourceModules;
+
+	// Handles of all labels with a source, sorted by name, for the prefix
+	// searches of the source selector. Rebuilt on demand once sources changed,
+	// sourceVersion is bumped on every change.
+	std::vector<LabelHandle> sortedSources;
+	uint32_t sourceVersion = 0;
+	uint32_t sortedVersion = UINT32_MAX;
+
+	LabelRegistry();
+
+	// Return the handle for lbl, adding it to the registry if necessary. A
+	// new handle isn't referenced yet, it's meant to be retained right away.
+	LabelHandle intern(const std::string &lbl);
+
+	// Return the handle for lbl, or NO_LABEL if it was never interned.
+	LabelHandle find(const std::string &lbl) const;
+
+	// Intern and return a label that was never interned before.
+	LabelHandle generate();
+
+	const std::string &name(LabelHandle h) const {
+		return names[h];
+	}
+
+	// One past the largest handle handed out so far, for iterating. Released
+	// handles in the range have empty names.
+	LabelHandle end() const {
+		return names.size();
+	}
+
+	// Number of labels currently interned.
+	size_t size() const {
+		return names.size() - 1 - freeHandles.size();
+	}
+
+	void retain(LabelHandle h) {
+		if(h == NO_LABEL) return;
+		refs[h]++;
+	}
+
+	// Drop a reference taken with retain(), and the label with the last one.
+	void release(LabelHandle h) {
+		if(h == NO_LABEL) return;
+		assert(refs[h] > 0);
+		if(--refs[h] == 0) {
+			erase(h);
+		}
+	}
+
+	bool hasSource(LabelHandle h) const {
+		return h != NO_LABEL && sources[h].module != NULL;
+	}
+
+	const Source &getSource(LabelHandle h) const {
+		return sources[h];
+	}
+
+	void setSource(LabelHandle h, Patchbay *module, int port) {
+		if(h == NO_LABEL) return;
+		sources[h].module = module;
+		sources[h].port = port;
+		sourceVersion++;
+	}
+
+	// Unregister the source of h, but only if it's owned by module.
+	void clearSource(LabelHandle h, Patchbay *module) {
+		if(sources[h].module == module) {
+			sources[h] = Source();
+			sourceVersion++;
+		}
+	}
+
+	const std::vector<LabelHandle> &getSortedSources();
+
+	// The range [*begin, *end) of getSortedSources() whose names start with
+	// prefix, found by binary search.
+	void findSourcesByPrefix(const std::string &prefix, size_t *begin, size_t *end);
+
+	const std::vector<Subscriber> &getSubscribers(LabelHandle h) const {
+		return subscribers[h];
+	}
+
+	void subscribe(LabelHandle h, Patchbay *module, int port);
+	void unsubscribe(LabelHandle h, Patchbay *module, int port);
+
+	// All four are no-ops if the module is already (un)registered.
+	void addDestination(Patchbay *module) {
+		addModule(destinations, module);
+	}
+	void removeDestination(Patchbay *module) {
+		removeModule(destinations, module);
+	}
+	void addSourceModule(Patchbay *module) {
+		addModule(sourceModules, module);
+	}
+	void removeSourceModule(Patchbay *module) {
+		removeModule(sourceModules, module);
+	}
+
+	bool hasSourceModule(Patchbay *module) const;
+
+	// Everything in the registry, for the diagnostics dump.
+	json_t *toJson();
+
+	static void addModule(std::vector<Patchbay*> &modules, Patchbay *module);
+	static void removeModule(std::vector<Patchbay*> &modules, Patchbay *module);
+
+	static uint32_t hash(const std::string &lbl);
+	void grow();
+	void erase(LabelHandle h);
+};
@@ -1,60 +1,175 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <map>
+#include <osdialog.h>
 
 #include "plugin.hpp"
 #include "Widgets.hpp"
 #include "Util.hpp"
+#include "LabelRegistry.hpp"
+#include "Profile.hpp"
+#include "Transport.hpp"
+
+// Patchbay modules come in 4, 8, 16 and 32 port variants. Per-port state is
+// sized for the largest one, numPorts says how much of it is in use. Ports
+// are laid out in columns of 8, one panel width each.
+#define MAX_PATCHBAY_PORTS 32
+#define PATCHBAY_PORTS_PER_COLUMN 8
+
+// A counter for the diagnostics menu. Each counter is only ever written by one
+// thread, so it's bumped with a relaxed load and store instead of a locked
+// read-modify-write. Readers may see a slightly stale value.
+struct PatchbayCounter {
+	std::atomic<uint64_t> value;
+
+	PatchbayCounter() : value(0) {}
+
+	void add(uint64_t n = 1) {
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	uint64_t get() const {
+		return value.load(std::memory_order_relaxed);
+	}
+};
+
+typedef std::vector<std::pair<std::string, uint64_t>> PatchbayCounterList;
 
-#define NUM_PATCHBAY_INPUTS 8
 struct Patchbay : Module {
-	std::string label[NUM_PATCHBAY_INPUTS];
-	Patchbay(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+	const int numPorts;
+	// Each port holds a reference to its label, see replaceLabel().
+	LabelHandle label[MAX_PATCHBAY_PORTS] = {};
+	// position in the registry's module list, -1 when not registered
+	int registryIdx = -1;
+	// Whether our labels are published in the registry. Modules only register
+	// in onAdd(), so loading a patch just sets handles in dataFromJson() and
+	// each route is resolved once, when its endpoint is added to the engine.
+	bool registered = false;
+	// Bumped whenever what the label display of a port shows changes (its
+	// label, or whether the route is valid), so widgets only update when it
+	// differs from the value they last saw. UI thread only.
+	uint32_t labelGeneration[MAX_PATCHBAY_PORTS] = {};
+
+	// Bumped by onPortChange() whenever a cable is connected to or removed
+	// from one of our ports. Cable descriptions for tooltips are cached per
+	// port until it changes, see getCableText().
+	std::atomic<uint32_t> cableGeneration;
+	struct CableText {
+		uint32_t generation = 0;
+		std::string text;
+	};
+	CableText cableText[MAX_PATCHBAY_PORTS];
+
+	Patchbay(int numPorts, int numParams, int numInputs, int numOutputs, int numLights = 0) : numPorts(numPorts), cableGeneration(1) {
+		assert(numPorts <= MAX_PATCHBAY_PORTS);
 		config(numParams, numInputs, numOutputs, numLights);
 	}
 
-	// This static map is used for keeping track of all existing Patchbay instances.
-	// We're using a map instead of a set because it's easier to search.
-	static std::map<std::string, Patchbay*> sources;
-	static std::map<std::string, Patchbay*> destinations;
+	~Patchbay() {
+		for(int i = 0; i < numPorts; i++) {
+			registry.release(label[i]);
+		}
+	}
+
+	// All labels in use are interned here, along with the PatchbayIn port
+	// currently publishing each of them.
+	static LabelRegistry registry;
 
-	// Generate random, unique label for this Patchbay endpoint. Don't modify the sources map.
-	std::string getLabel() {
-		std::string l;
-		do {
-			l = randomString(EditableTextBox::defaultTextLength);
-		} while(sourceExists(l) || destinationExists(l)); // if the label exists, regenerate
-		return l;
+	// Counters are only collected while this is set, from the Diagnostics
+	// menu. When it's off the engine path only tests this flag, with relaxed
+	// loads: counting a few frames more or less doesn't matter.
+	static std::atomic<bool> collectDiagnostics;
+	// routes made and broken, counted on the UI thread
+	PatchbayCounter attachCalls;
+	PatchbayCounter detachCalls;
+
+	virtual void getCounters(PatchbayCounterList &counters) {
+		counters.push_back(std::make_pair("attach_calls", attachCalls.get()));
+		counters.push_back(std::make_pair("detach_calls", detachCalls.get()));
 	}
 
-	inline bool sourceExists(std::string lbl) {
-		return (
-			sources.find(lbl) != sources.end()
-		);
+	// Generate a unique label for this Patchbay endpoint. Don't modify the registry sources.
+	LabelHandle getLabel() {
+		return registry.generate();
 	}
 
+	// Set the handle of port idx, moving its reference from the old label to
+	// the new one. The registry is only used on the UI thread.
+	void replaceLabel(int idx, LabelHandle lbl) {
+		registry.retain(lbl);
+		registry.release(label[idx]);
+		label[idx] = lbl;
+	}
 
-	inline bool destinationExists(std::string lbl) {
-		return (
-			destinations.find(lbl) != destinations.end()
-		);
+	const std::string &getLabelText(int idx) {
+		return registry.name(label[idx]);
 	}
 
-	int getIOIdx(std::string lbl) {
-		for (int i = 0; i < NUM_PATCHBAY_INPUTS; i++) {
-			if (lbl.compare(label[i]) == 0) {
-				return i;
-			}
+	inline bool sourceExists(LabelHandle lbl) {
+		return registry.hasSource(lbl);
+	}
+
+	void onPortChange(const PortChangeEvent &e) override {
+		cableGeneration.fetch_add(1);
+	}
+
+	// Description of the cables on port idx, one line each. UI thread only,
+	// looking cables up walks all of them, so it's only done after a change.
+	const std::string &getCableText(int idx) {
+		CableText &cached = cableText[idx];
+		uint32_t generation = cableGeneration.load();
+		if(cached.generation != generation) {
+			cached.generation = generation;
+			cached.text = describeCables(idx);
+		}
+		return cached.text;
+	}
+
+	virtual std::string describeCables(int idx) {
+		return "";
+	}
+
+	// PatchbayOut updates channel counts and lights only every this many
+	// samples, see its housekeepingDivider.
+	static const int HOUSEKEEPING_DIVISION = 32;
+
+	// Version of the patch data written by dataToJson(). Version 1, without
+	// a "version" key, stored each label under its own "label<N>" key,
+	// version 2 stores them all in a "labels" array. Both are read.
+	static const int JSON_VERSION = 2;
+
+	void labelsToJson(json_t *root) {
+		json_t *labels = json_array();
+		for(int i = 0; i < numPorts; i++) {
+			json_array_append_new(labels, json_string(getLabelText(i).c_str()));
+		}
+		json_object_set_new(root, "version", json_integer(JSON_VERSION));
+		json_object_set_new(root, "labels", labels);
+	}
+
+	// The saved label of port idx, or NULL if there's none. labels is the
+	// "labels" array of root, or NULL for version 1 data.
+	static json_t *labelFromJson(json_t *root, json_t *labels, int idx) {
+		if(labels) {
+			return json_array_get(labels, idx);
 		}
 
-		return 0;
+		char key[16];
+		snprintf(key, sizeof(key), "label%d", idx);
+		return json_object_get(root, key);
 	}
 
-	void setInput(int idx, Patchbay* pbIn, int input_Idx) {
+	static json_t *labelsFromJson(json_t *root) {
+		json_t *labels = json_object_get(root, "labels");
+		return json_is_array(labels) ? labels : NULL;
 	}
 
-	void removeInput(int idx) {
+	virtual void setInput(int idx, Patchbay* pbIn, int input_Idx) {
+	}
+
+	virtual void removeInput(int idx) {
 	}
 };
 
@@ -62,32 +177,62 @@ struct PatchbayLabelDisplay {
 	NVGcolor errorTextColor = nvgRGB(0xd8, 0x0, 0x0);
 };
 
+// Menus may outlive the modules they were opened for, so they refer to them
+// by ID and look them up when they act. NULL once the module is gone.
+template <class TModule>
+inline TModule *findPatchbayModule(int64_t moduleId) {
+	return dynamic_cast<TModule*>(APP->engine->getModule(moduleId));
+}
+
 struct PatchbayModuleWidget : ModuleWidget {
 	HoverableTextBox *labelDisplay;
 	Patchbay *module;
+	float columnWidth;
 
+	// Label displays are drawn through their own framebuffer, so they're only
+	// rendered again when their text, color or hover state changes.
 	virtual void addLabelDisplay(HoverableTextBox *disp, int idx) {
 		disp->font_size = 12;
 		disp->box.size = Vec(50,12);
 		disp->textOffset.x = disp->box.size.x * 0.5f;
-		disp->box.pos = Vec(5.0f, getLabelYCoord(idx));
 		labelDisplay = disp;
-		addChild(labelDisplay);
+
+		FramebufferWidget *fb = new FramebufferWidget();
+		fb->box.pos = Vec(5.0f + getColumnXCoord(idx), getLabelYCoord(idx));
+		fb->box.size = disp->box.size;
+		fb->addChild(labelDisplay);
+		addChild(fb);
+	}
+
+	float getColumnXCoord(int i) {
+		return columnWidth * (i / PATCHBAY_PORTS_PER_COLUMN);
 	}
 
 	float getPortYCoord(int i) {
-		return 54.0f + (RACK_GRID_WIDTH + 27.0f) * (i);
+		return 54.0f + (RACK_GRID_WIDTH + 27.0f) * (i % PATCHBAY_PORTS_PER_COLUMN);
 	}
 
 	float getLabelYCoord(int i) {
 	
-		return 30.0f + ((RACK_GRID_WIDTH + 27.0f) * (i));
+		return 30.0f + ((RACK_GRID_WIDTH + 27.0f) * (i % PATCHBAY_PORTS_PER_COLUMN));
 	}
 
-	PatchbayModuleWidget(Patchbay *module, std::string panelFilename) {
+	PatchbayModuleWidget(Patchbay *module, std::string panelFilename, int numPorts) {
 		setModule(module);
 		this->module = module;
-		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, panelFilename)));
+		std::shared_ptr<Svg> svg = APP->window->loadSvg(asset::plugin(pluginInstance, panelFilename));
+		setPanel(svg);
+
+		// the panel holds one column of ports, repeat it for the others
+		columnWidth = box.size.x;
+		int columns = (numPorts + PATCHBAY_PORTS_PER_COLUMN - 1) / PATCHBAY_PORTS_PER_COLUMN;
+		for(int c = 1; c < columns; c++) {
+			SvgPanel *column = new SvgPanel();
+			column->setBackground(svg);
+			column->box.pos.x = c * columnWidth;
+			addChild(column);
+		}
+		box.size.x = columns * columnWidth;
 
 		// addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH * 0.5f, 0)));
 		// addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH * 0.5f, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
@@ -95,5 +240,71 @@ struct PatchbayModuleWidget : ModuleWidget {
 		// addChild(createWidget<ScrewSilver>(Vec(45.0f - (RACK_GRID_WIDTH * 0.5f), RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 
 	}
-};
 
+	void step() override {
+		ModuleWidget::step();
+		reclaimRetired();
+	}
+
+	void appendDiagnosticsMenu(Menu *menu) {
+		int64_t moduleId = module->id;
+
+		menu->addChild(createSubmenuItem("Diagnostics", "", [=](Menu *menu) {
+			menu->addChild(createBoolMenuItem("Collect counters", "",
+				[]() {return Patchbay::collectDiagnostics.load();},
+				[](bool collect) {Patchbay::collectDiagnostics.store(collect);}
+			));
+
+			Patchbay *module = findPatchbayModule<Patchbay>(moduleId);
+			if(module) {
+				PatchbayCounterList counters;
+				module->getCounters(counters);
+				for(auto &counter : counters) {
+					menu->addChild(createMenuLabel(string::f("%s: %llu", counter.first.c_str(), (unsigned long long) counter.second)));
+				}
+			}
+
+			LabelRegistry &registry = Patchbay::registry;
+			menu->addChild(new MenuSeparator);
+			menu->addChild(createMenuLabel(string::f("Registry: %d labels, %d sources, %d destinations",
+				(int) registry.size(), (int) registry.sourceModules.size(), (int) registry.destinations.size())));
+			menu->addChild(createMenuItem("Dump registry to JSON...", "", [=]() {
+				// the whole registry, with the counters of every module
+				saveJson(Patchbay::registry.toJson(), "patchbay-registry.json");
+			}));
+
+#ifdef PATCHBAY_PROFILE
+			menu->addChild(new MenuSeparator);
+			for(int s = 0; s < NUM_PROFILE_SECTIONS; s++) {
+				profile::Stats stats = profile::getStats((ProfileSection) s);
+				menu->addChild(createMenuLabel(string::f("%s: n=%llu p50<%lluns p99<%lluns max=%lluns",
+					profile::getSectionName((ProfileSection) s), (unsigned long long) stats.count,
+					(unsigned long long) stats.p50, (unsigned long long) stats.p99, (unsigned long long) stats.max)));
+			}
+			menu->addChild(createMenuItem("Dump profile to JSON...", "", [=]() {
+				saveJson(profile::toJson(), "patchbay-profile.json");
+			}));
+#endif
+		}));
+	}
+
+	// Write data to a file picked by the user, and release it.
+	static void saveJson(json_t *data, const char *defaultName) {
+		osdialog_filters *filters = osdialog_filters_parse("JSON:json");
+		char *path = osdialog_file(OSDIALOG_SAVE, NULL, defaultName, filters);
+		osdialog_filters_free(filters);
+
+		if(path) {
+			FILE *file = std::fopen(path, "w");
+			if(file) {
+				json_dumpf(data, file, JSON_INDENT(2));
+				std::fclose(file);
+			} else {
+				WARN("Could not write %s", path);
+			}
+			std::free(path);
+		}
+
+		json_decref(data);
+	}
+};
@@ -2,24 +2,20 @@
 
 #include "Patchbay.hpp"
 #include "PatchbayOut.hpp"
+#include "SharedTransport.hpp"
+#include "Transport.hpp"
 #include "plugin.hpp"
 
-std::map<std::string, Patchbay*> Patchbay::sources = {};
+LabelRegistry Patchbay::registry;
+std::atomic<bool> Patchbay::collectDiagnostics(false);
 
 struct PatchbayIn : Patchbay {
 	enum ParamIds {
 		NUM_PARAMS
 	};
+	// followed by the other numPorts - 1 inputs
 	enum InputIds {
-		INPUT_1,
-		INPUT_2,
-		INPUT_3,
-		INPUT_4,
-		INPUT_5,
-		INPUT_6,
-		INPUT_7,
-		INPUT_8,
-		NUM_INPUTS
+		INPUT_1
 	};
 	enum OutputIds {
 		NUM_OUTPUTS
@@ -28,137 +24,360 @@ struct PatchbayIn : Patchbay {
 		NUM_LIGHTS
 	};
 
+	// Frames published for PatchbayOut modules, one buffer per port. These are
+	// what other modules read, never our inputs[] directly.
+	PortBuffer *buffers;
+
+	// Number of PatchbayOut ports routed from each of our ports. A port is
+	// published once per frame however many listeners it has, and not at all
+	// without any. Bit i of listenedPorts is set while listeners[i] > 0.
+	int listeners[MAX_PATCHBAY_PORTS] = {};
+	std::atomic<uint32_t> listenedPorts;
+
+	// In bus mode the label of port 1 carries the first (up to 16) inputs as
+	// one polyphonic signal, channel j taken from the first channel of input
+	// j. The other labels are still published as usual. Set by the UI thread,
+	// the engine picks it up on the next frame.
+	std::atomic<bool> busMode;
+
+	// When set, every label is also published to other Rack instances on
+	// this host, see SharedTransport.hpp. A port has a writer unless another
+	// instance shares the same label already. The writers are replaced by the
+	// UI thread and pushed to by the engine, bit i of sharedPorts is set while
+	// writers[i] is.
+	bool shared = false;
+	std::atomic<SharedWriter*> writers[MAX_PATCHBAY_PORTS];
+	std::atomic<uint32_t> sharedPorts;
+
+	// frames published per port, written by the engine
+	PatchbayCounter framesPublished[MAX_PATCHBAY_PORTS];
+
 	// Change the label of this input, if the label doesn't exist already.
 	// Return whether the label was updated.
 	bool updateLabel(std::string lbl, int idx = 0) {
-		if(lbl.empty() || sourceExists(lbl)) {
+		PATCHBAY_PROFILE_SCOPE(PROFILE_UPDATE_LABEL);
+		if(lbl.empty()) {
+			return false;
+		}
+
+		LabelHandle handle = registry.intern(lbl);
+		if(sourceExists(handle)) {
 			return false;
 		}
 
-		std::string oldLabel = label[idx];
-		sources.erase(oldLabel); //TODO: mutex for this and erase() calls below?
-		label[idx] = lbl;
-		addSource(this);
+		detachSubscribers(idx);
+		// the registry is only used on the UI thread, the engine only sees the
+		// resulting routes, through PatchbayOut's command queue
+		registry.clearSource(label[idx], this);
+		replaceLabel(idx, handle);
+		labelGeneration[idx]++;
+		registry.setSource(handle, this, idx);
+		attachSubscribers(idx);
+		updateWriter(idx);
 
 		return true;
 	}
 
-	PatchbayIn() : Patchbay(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {
-		assert(NUM_INPUTS == NUM_PATCHBAY_INPUTS);
+	PatchbayIn(int numPorts) : Patchbay(numPorts, NUM_PARAMS, numPorts, NUM_OUTPUTS, NUM_LIGHTS), listenedPorts(0), busMode(false), sharedPorts(0) {
+		buffers = createPortBuffers(numPorts);
 
-		for(int i = 0; i < NUM_PATCHBAY_INPUTS; i++) {
+		for(int i = 0; i < numPorts; i++) {
+			writers[i].store(NULL);
 			configInput(i, string::f("Port %d", i + 1));
-			label[i] = getLabel();
 		}
-		
-		attachDestinations();
-		addSource(this);
 	}
 
 	~PatchbayIn() {
-		detachDestinations();
-		eraseInputs();
+		removeFromRegistry();
+		// routes to us are gone, but a PatchbayOut may still be reading
+		retirePortBuffers(buffers, numPorts);
+	}
+
+	void onAdd(const AddEvent &e) override {
+		addToRegistry();
+		reclaimRetired();
 	}
 
-	void addSource(Patchbay *t) {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			std::string key = t->label[i];
-			sources[key] = t;
+	void onRemove(const RemoveEvent &e) override {
+		removeFromRegistry();
+		reclaimRetired();
+	}
+
+	// Publish our labels and connect the PatchbayOut ports waiting for them.
+	// Ports without a label, not loaded from a patch, get a generated one
+	// here, so modules that never make it into the engine don't intern any.
+	void addToRegistry() {
+		if(registered) return;
+
+		for(int i=0; i  < numPorts; i++) {
+			if(label[i] == NO_LABEL || sourceExists(label[i])) {
+				// new module, or another module registered the same label
+				// after ours was loaded (e.g. a duplicate), pick a new one
+				replaceLabel(i, getLabel());
+				labelGeneration[i]++;
+			}
+			registry.setSource(label[i], this, i);
 		}
+
+		registry.addSourceModule(this);
+		registered = true;
+		attachDestinations();
+		updateWriters();
 	}
 
-	void attachDestinations() {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			std::string key = label[i];
+	void removeFromRegistry() {
+		if(!registered) return;
+
+		detachDestinations();
+		eraseInputs();
+		registry.removeSourceModule(this);
+		registered = false;
+		updateWriters();
+	}
 
-			for (auto const& x : destinations) {
-				Patchbay *const outputBay = dynamic_cast<Patchbay*>(x.second);
+	void setShared(bool shared) {
+		this->shared = shared;
+		updateWriters();
+	}
 
-				for (int j = 0; j < NUM_PATCHBAY_INPUTS; j++) {
-					if (key == outputBay->label[j]) {
-						Patchbay* inputBay = dynamic_cast<Patchbay*>(this);
-						outputBay->setInput(j, inputBay, i);
-					}
-				}
+	// Open or close the writer of port idx to match the label and whether
+	// we're shared and registered.
+	void updateWriter(int idx) {
+		SharedWriter *writer = writers[idx].load();
+		bool wanted = shared && registered && label[idx] != NO_LABEL;
+		std::string name = wanted ? getLabelText(idx) : "";
+		if(writer && writer->label == name) return;
+
+		if(writer) {
+			sharedPorts.fetch_and(~(1u << idx));
+			writers[idx].store(NULL);
+			closeSharedWriter(writer);
+		}
+		if(wanted) {
+			writer = openSharedWriter(name);
+			if(writer) {
+				writers[idx].store(writer, std::memory_order_release);
+				sharedPorts.fetch_or(1u << idx, std::memory_order_release);
 			}
 		}
 	}
 
-	void detachDestinations() {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			std::string key = label[i];
-
-			for (auto const& x : destinations) {
-				Patchbay *const outputBay = dynamic_cast<Patchbay*>(x.second);
+	void updateWriters() {
+		for(int i = 0; i < numPorts; i++) {
+			updateWriter(i);
+		}
+	}
 
-				for (int j = 0; j < NUM_PATCHBAY_INPUTS; j++) {
-					if (key == outputBay->label[j]) {
-						outputBay->removeInput(j);
-					}
+	// Push the frame of the shared ports, on the engine thread.
+	void pushShared(uint32_t shared, int64_t frame, int busChannels) {
+		while(shared) {
+			int i = __builtin_ctz(shared);
+			shared &= shared - 1;
+
+			SharedWriter *writer = writers[i].load(std::memory_order_acquire);
+			if(!writer) continue;
+			if(i == 0 && busMode.load(std::memory_order_relaxed)) {
+				float bus[PORT_MAX_CHANNELS] = {};
+				for(int j = 0; j < busChannels; j++) {
+					bus[j] = inputs[j].getVoltage();
 				}
+				writer->push(frame, bus, busChannels);
+			} else {
+				writer->push(frame, inputs[i].voltages, inputs[i].getChannels());
 			}
 		}
 	}
 
-	json_t* dataToJson() override {
-		json_t *data = json_object();
+	// Point every PatchbayOut port that selected the label of port idx at it.
+	void attachSubscribers(int idx) {
+		if(collectDiagnostics) attachCalls.add();
+		for (auto const& sub : registry.getSubscribers(label[idx])) {
+			sub.module->setInput(sub.port, this, idx);
+		}
+	}
 
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			// Create a character array to hold the concatenated string
-			char buffer[16]; // Adjust the size as needed
+	void detachSubscribers(int idx) {
+		if (registry.getSource(label[idx]).module != this) {
+			// not ours to detach
+			return;
+		}
+		if(collectDiagnostics) detachCalls.add();
 
-			// Use snprintf to format the combination
-			snprintf(buffer, sizeof(buffer), "label%d", i);
+		for (auto const& sub : registry.getSubscribers(label[idx])) {
+			sub.module->removeInput(sub.port);
+		}
+	}
 
-			// The buffer now contains the concatenated C-style string
-			const char* key = buffer;
+	void attachDestinations() {
+		PATCHBAY_PROFILE_SCOPE(PROFILE_ATTACH_DESTINATIONS);
+		for(int i=0; i  < numPorts; i++) {
+			attachSubscribers(i);
+		}
+	}
 
-			json_object_set_new(data, key, json_string(label[i].c_str()));
+	void detachDestinations() {
+		for(int i=0; i  < numPorts; i++) {
+			detachSubscribers(i);
 		}
+	}
+
+	json_t* dataToJson() override {
+		json_t *data = json_object();
+
+		labelsToJson(data);
+		json_object_set_new(data, "busMode", json_boolean(busMode.load()));
+		json_object_set_new(data, "shared", json_boolean(shared));
 
 		return data;
 	}
 
 	void dataFromJson(json_t* root) override {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			// Create a character array to hold the concatenated string
-			char buffer[16]; // Adjust the size as needed
+		PATCHBAY_PROFILE_SCOPE(PROFILE_DATA_FROM_JSON);
+		// When loading a patch we're not registered yet and this only sets
+		// handles. A live module (e.g. loading a preset) is re-registered.
+		bool wasRegistered = registered;
+		removeFromRegistry();
+
+		json_t *labels_json = labelsFromJson(root);
+		for(int i=0; i  < numPorts; i++) {
+			json_t *label_json = labelFromJson(root, labels_json, i);
+			// If the label couldn't be read, or it already exists in sources
+			// because dataFromJson() was called for a duplicate instead of
+			// loading from file, it's left empty and addToRegistry() generates
+			// a new one.
+			LabelHandle handle = NO_LABEL;
+			if(json_is_string(label_json)) {
+				handle = registry.intern(json_string_value(label_json));
+			}
+			replaceLabel(i, sourceExists(handle) ? NO_LABEL : handle);
+			labelGeneration[i]++;
+		}
 
-			// Use snprintf to format the combination
-			snprintf(buffer, sizeof(buffer), "label%d", i);
+		json_t *bus_json = json_object_get(root, "busMode");
+		if(bus_json) {
+			busMode.store(json_is_true(bus_json));
+		}
 
-			// The buffer now contains the concatenated C-style string
-			const char* key = buffer;
+		json_t *shared_json = json_object_get(root, "shared");
+		if(shared_json) {
+			// writers are opened by addToRegistry()
+			shared = json_is_true(shared_json);
+		}
 
-			json_t *label_json = json_object_get(root, key);
-			if(json_is_string(label_json)) {
-				// remove previous label randomly generated in constructor
-				sources.erase(label[i]);
-				label[i] = std::string(json_string_value(label_json));
-
-				if(sourceExists(label[i])) {
-					// Label already exists in sources, this means that dataFromJson()
-					// was called due to duplication instead of loading from file.
-					// Generate new label.
-					label[i] = getLabel();
-				}
-			} else {
-				// label couldn't be read from json for some reason, generate new one
-				label[i] = getLabel();
+		if(wasRegistered) {
+			addToRegistry();
+		}
+	}
+
+	// The module feeding input idx, shown in PatchbayOut tooltips.
+	std::string describeCables(int idx) override {
+		std::string text;
+		app::ModuleWidget *mw = APP->scene->rack->getModule(id);
+		if(!mw) return text;
+
+		for(app::CableWidget *cw : APP->scene->rack->getCompleteCablesOnPort(mw->getInput(idx))) {
+			text += "\n";
+			text += "Patchbaying from ";
+			text += cw->outputPort->module->model->getFullName();
+			text += ": ";
+			text += cw->outputPort->getPortInfo()->getName();
+			text += " ";
+			text += "output";
+		}
+		return text;
+	}
+
+	void getCounters(PatchbayCounterList &counters) override {
+		Patchbay::getCounters(counters);
+		for(int i = 0; i < numPorts; i++) {
+			counters.push_back(std::make_pair(string::f("port%d_frames_published", i + 1), framesPublished[i].get()));
+		}
+		for(int i = 0; i < numPorts; i++) {
+			SharedWriter *writer = writers[i].load();
+			if(writer) {
+				counters.push_back(std::make_pair(string::f("port%d_shared_frames_dropped", i + 1), writer->dropped.load()));
 			}
 		}
+	}
 
-		addSource(this);
-		attachDestinations();
+	void countPublished(uint32_t published) {
+		while(published) {
+			int i = __builtin_ctz(published);
+			published &= published - 1;
+			framesPublished[i].add();
+		}
 	}
 
-	void onRemove (const RemoveEvent & e) override {
-		eraseInputs();
+	// Called by PatchbayOut when it starts or stops reading port idx.
+	void addListener(int idx) {
+		if(listeners[idx]++ == 0) {
+			listenedPorts.fetch_or(1u << idx, std::memory_order_release);
+		}
+	}
+
+	void removeListener(int idx) {
+		if(--listeners[idx] == 0) {
+			listenedPorts.fetch_and(~(1u << idx));
+		}
 	}
 
 	void eraseInputs() {
-		for(int i=0; i < NUM_PATCHBAY_INPUTS; i++) {
-			sources.erase(label[i]);
+		for(int i=0; i < numPorts; i++) {
+			registry.clearSource(label[i], this);
+		}
+	}
+};
+
+// The engine-side part of PatchbayIn, specialized on the port count so the
+// per-port loop has a compile time bound and can be unrolled.
+template <int PORTS>
+struct PatchbayInModule : PatchbayIn {
+	static const int BUS_CHANNELS = PORTS < PORT_MAX_CHANNELS ? PORTS : PORT_MAX_CHANNELS;
+
+	PatchbayInModule() : PatchbayIn(PORTS) {}
+
+	void process(const ProcessArgs &args) override {
+		PATCHBAY_PROFILE_SCOPE(PROFILE_IN_PROCESS);
+		uint32_t listened = listenedPorts.load(std::memory_order_acquire);
+		bool bus = busMode.load(std::memory_order_relaxed);
+
+		for(int i = 0; i < PORTS; i++) {
+			if(listened & (1u << i)) {
+				if(i == 0 && bus) {
+					buffers[0].publishBus(args.frame, &inputs[0], BUS_CHANNELS);
+				} else {
+					buffers[i].publish(args.frame, inputs[i]);
+				}
+			}
+		}
+
+		uint32_t shared = sharedPorts.load(std::memory_order_acquire);
+		if(shared) {
+			pushShared(shared, args.frame, BUS_CHANNELS);
+		}
+
+		if(collectDiagnostics.load(std::memory_order_relaxed)) {
+			countPublished(listened & ((1ull << PORTS) - 1));
+		}
+	}
+
+	// Bypassed, the ports carry nothing. Empty frames are published so routed
+	// PatchbayOut ports go silent instead of holding the last one.
+	void processBypass(const ProcessArgs &args) override {
+		uint32_t listened = listenedPorts.load(std::memory_order_acquire);
+		for(int i = 0; i < PORTS; i++) {
+			if(listened & (1u << i)) {
+				buffers[i].publish(args.frame, inputs[i].voltages, 0);
+			}
+		}
+
+		uint32_t shared = sharedPorts.load(std::memory_order_acquire);
+		while(shared) {
+			int i = __builtin_ctz(shared);
+			shared &= shared - 1;
+
+			SharedWriter *writer = writers[i].load(std::memory_order_acquire);
+			if(writer) writer->push(args.frame, inputs[i].voltages, 0);
 		}
 	}
 };
@@ -170,6 +389,11 @@ struct EditablePatchbayLabelTextbox : EditableTextBox, PatchbayLabelDisplay {
 	GUITimer errorDisplayTimer;
 	float errorDuration = 3.f;
 
+	// what the display was last updated for, see step()
+	uint32_t generation = UINT32_MAX;
+	bool showingError = false;
+	bool editing = false;
+
 	EditablePatchbayLabelTextbox(PatchbayIn *m, int idx): EditableTextBox() {
 		assert(errorText.size() <= maxTextLength);
 		this->idx = idx;
@@ -177,7 +401,7 @@ struct EditablePatchbayLabelTextbox : EditableTextBox, PatchbayLabelDisplay {
 	}
 
 	void onDeselect(const event::Deselect &e) override {
-		if(module->updateLabel(TextField::text, idx) || module->label[idx].compare(TextField::text) == 0) {
+		if(module->updateLabel(TextField::text, idx) || module->getLabelText(idx).compare(TextField::text) == 0) {
 			errorDisplayTimer.reset();
 		} else {
 			errorDisplayTimer.trigger(errorDuration);
@@ -188,29 +412,77 @@ struct EditablePatchbayLabelTextbox : EditableTextBox, PatchbayLabelDisplay {
 	}
 
 	void step() override {
+		if(module) {
+			updateText();
+		}
 		EditableTextBox::step();
-		if(!module) return;
-		if(errorDisplayTimer.process()) {
-			textColor = isFocused ? defaultTextColor : errorTextColor;
+	}
+
+	// Only touch the text when the label, the error timer or the focus changed.
+	void updateText() {
+		bool error = errorDisplayTimer.process();
+		uint32_t gen = module->labelGeneration[idx];
+		if(gen == generation && error == showingError && isFocused == editing) {
+			return;
+		}
+		generation = gen;
+		showingError = error;
+		editing = isFocused;
+
+		if(error) {
+			setTextColor(isFocused ? defaultTextColor : errorTextColor);
 			HoverableTextBox::setText(errorText);
 		} else {
-			textColor = defaultTextColor;
-			HoverableTextBox::setText(module->label[idx]);
+			setTextColor(defaultTextColor);
+			HoverableTextBox::setText(module->getLabelText(idx));
 			if(!isFocused) {
-				TextField::setText(module->label[idx]);
+				TextField::setText(module->getLabelText(idx));
 			}
 		}
 	}
 
 };
+template <int PORTS>
 struct PatchbayInModuleWidget : PatchbayModuleWidget {
-	PatchbayInModuleWidget(PatchbayIn *module) : PatchbayModuleWidget(module, "res/PB-O.svg") {
-		for(int i = 0; i < NUM_PATCHBAY_INPUTS; i++) {
+	PatchbayInModuleWidget(PatchbayInModule<PORTS> *module) : PatchbayModuleWidget(module, PORTS == 4 ? "res/PB-O-4.svg" : "res/PB-O.svg", PORTS) {
+		for(int i = 0; i < PORTS; i++) {
 			addLabelDisplay(new EditablePatchbayLabelTextbox(module, i), i);
-			addInput(createInputCentered<PJ301MPort>(Vec(30, getPortYCoord(i)), module, PatchbayIn::INPUT_1 + i));
+			addInput(createInputCentered<PJ301MPort>(Vec(30 + getColumnXCoord(i), getPortYCoord(i)), module, PatchbayIn::INPUT_1 + i));
 		}
 	}
 
+	void appendContextMenu(Menu *menu) override {
+		int64_t moduleId = this->module->id;
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createBoolMenuItem(string::f("Bus mode (port 1 carries ports 1-%d)", PatchbayInModule<PORTS>::BUS_CHANNELS), "",
+			[=]() {
+				PatchbayIn *module = findPatchbayModule<PatchbayIn>(moduleId);
+				return module && module->busMode.load();
+			},
+			[=](bool busMode) {
+				PatchbayIn *module = findPatchbayModule<PatchbayIn>(moduleId);
+				if(module) module->busMode.store(busMode);
+			}
+		));
+#ifdef PATCHBAY_SHARED_TRANSPORT
+		menu->addChild(createBoolMenuItem("Share labels with other Rack instances", "",
+			[=]() {
+				PatchbayIn *module = findPatchbayModule<PatchbayIn>(moduleId);
+				return module && module->shared;
+			},
+			[=](bool shared) {
+				PatchbayIn *module = findPatchbayModule<PatchbayIn>(moduleId);
+				if(module) module->setShared(shared);
+			}
+		));
+#endif
+		appendDiagnosticsMenu(menu);
+	}
+
 };
 
-Model *modelPatchbayInModule = createModel<PatchbayIn, PatchbayInModuleWidget>("PatchbayIn");
+Model *modelPatchbayInModule = createModel<PatchbayInModule<8>, PatchbayInModuleWidget<8>>("PatchbayIn");
+Model *modelPatchbayIn4Module = createModel<PatchbayInModule<4>, PatchbayInModuleWidget<4>>("PatchbayIn4");
+Model *modelPatchbayIn16Module = createModel<PatchbayInModule<16>, PatchbayInModuleWidget<16>>("PatchbayIn16");
+Model *modelPatchbayIn32Module = createModel<PatchbayInModule<32>, PatchbayInModuleWidget<32>>("PatchbayIn32");
@@ -1,3 +1,6 @@
 #include "PatchbayOut.hpp"
 
-Model *modelPatchbayOutModule = createModel<PatchbayOut, PatchbayOutWidget>("PatchbayOut");
+Model *modelPatchbayOutModule = createModel<PatchbayOutModule<8>, PatchbayOutWidget<8>>("PatchbayOut");
+Model *modelPatchbayOut4Module = createModel<PatchbayOutModule<4>, PatchbayOutWidget<4>>("PatchbayOut4");
+Model *modelPatchbayOut16Module = createModel<PatchbayOutModule<16>, PatchbayOutWidget<16>>("PatchbayOut16");
+Model *modelPatchbayOut32Module = createModel<PatchbayOutModule<32>, PatchbayOutWidget<32>>("PatchbayOut32");
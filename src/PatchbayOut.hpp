@@ -3,28 +3,131 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <deque>
 
 #include "plugin.hpp"
 #include "Patchbay.hpp"
 #include "PatchbayIn.hpp"
+#include "SharedTransport.hpp"
 /////////////
 // modules //
 /////////////
 
 struct PatchbayOut : Patchbay {
 
-	bool sourceIsValid[NUM_PATCHBAY_INPUTS];
+	bool sourceIsValid[MAX_PATCHBAY_PORTS];
 	
-	PatchbayIn* inputs[NUM_PATCHBAY_INPUTS];
-	int inputIdx[NUM_PATCHBAY_INPUTS];
-
-	std::string moduleId;
-
-	bool isGreen[NUM_PATCHBAY_INPUTS] = {false};
-	bool isRed[NUM_PATCHBAY_INPUTS] = {false};
+	// Routes as seen by the UI thread. Every change is passed on to the
+	// engine as a Command, see pushCommand().
+	PatchbayIn* inputs[MAX_PATCHBAY_PORTS];
+	int inputIdx[MAX_PATCHBAY_PORTS];
+	// Set instead of inputs[i] while port i is routed from another Rack
+	// instance, see SharedTransport.hpp.
+	RemoteSource *remoteInputs[MAX_PATCHBAY_PORTS];
+
+	// Whether labels without a source in this instance are looked up in the
+	// other instances on this host.
+	bool receiveRemote = false;
+
+	// A route change, applied by the engine at the start of process().
+	struct Command {
+		enum Type {
+			SET_ROUTE,
+			CLEAR_ROUTE,
+			SET_UNBUNDLE,
+			SET_RATE,
+			SET_DELAYED
+		};
+		Type type;
+		int port;
+		// SET_ROUTE: the buffer of a local source, or the remote one
+		const PortBuffer *buffer = NULL;
+		RemoteSource *remote = NULL;
+		// SET_UNBUNDLE, SET_DELAYED: 1 to turn it on, 0 to turn it off
+		// SET_RATE: the division
+		int value = 0;
+		// SET_RATE: interpolate instead of holding
+		bool linear = false;
+		// see getRouteCommandSeq()
+		uint64_t seq = 0;
+	};
+	static const size_t COMMAND_QUEUE_SIZE = 64;
+	SpscQueue<Command, COMMAND_QUEUE_SIZE> commands;
+	// commands that didn't fit in the queue, UI thread only
+	std::deque<Command> overflowCommands;
+	// registered as a route consumer while we're in the engine
+	RouteCommandStats commandStats;
+
+	// Engine thread only from here, set by applyCommand().
+	// inputs[i]->buffers[inputIdx[i]], every port routed from the same source
+	// reads the same buffer. Buffers of deleted sources are reclaimed lazily,
+	// see retirePortBuffers(). NULL for remote routes.
+	const PortBuffer *sourceBuffers[MAX_PATCHBAY_PORTS];
+	bool busActive = false;
+	// Remote routes and the ports they're set for. They are polled at the
+	// start of every frame, and read from the shared segment in place.
+	RemoteSource *remoteSources[MAX_PATCHBAY_PORTS];
+	uint32_t remotePorts = 0;
+
+	// Slow CV doesn't need to be forwarded at audio rate. A port can instead
+	// be read every division samples (a power of two) and either hold that
+	// value or ramp to it linearly over the next division samples, which
+	// delays it by as much. Bus outputs in unbundle mode always run at audio
+	// rate.
+	struct PortRate {
+		int division = 1;
+		bool linear = false;
+	};
+	// UI thread copy
+	PortRate rates[MAX_PATCHBAY_PORTS];
+	// Engine thread only: the rates in effect, the ports they're set for,
+	// and the per-sample increments of linear ones.
+	PortRate engineRates[MAX_PATCHBAY_PORTS];
+	uint32_t slowPorts = 0;
+	float rampSteps[MAX_PATCHBAY_PORTS][PORT_MAX_CHANNELS] = {};
+	int rampChannels[MAX_PATCHBAY_PORTS] = {};
+
+	bool isGreen[MAX_PATCHBAY_PORTS] = {false};
+	bool isRed[MAX_PATCHBAY_PORTS] = {false};
 	
 	int procCounter = 0;
 
+	// When set, always read the frame PatchbayIn published on the previous
+	// engine frame, for a fixed latency of one sample. Otherwise read the most
+	// recent complete frame, which depends on processing order. This is the
+	// UI thread's copy, the engine follows engineDelayed.
+	bool delayedTransport = false;
+	bool engineDelayed = false;
+
+	// In unbundle mode output j carries channel j of the signal routed to
+	// port 1, for the first busChannels outputs, e.g. from a PatchbayIn in bus
+	// mode. Labels selected on the other bus outputs are ignored. This is the
+	// UI thread's copy, the engine follows busActive.
+	bool unbundle = false;
+	int busChannels;
+	uint32_t busPorts;
+
+	// Bit i of routedPorts is set while port i has a source, bit i of
+	// connectedPorts while output i has a cable. process() only visits ports
+	// with both bits set. Written on route and cable changes, so process()
+	// doesn't have to test every port on every sample. routedPorts belongs to
+	// the engine thread, like sourceBuffers.
+	uint32_t routedPorts;
+	std::atomic<uint32_t> connectedPorts;
+
+	// Channel counts and lights hardly ever change, they're only updated
+	// every HOUSEKEEPING_DIVISION samples. Voltages are always copied for the
+	// source's current channel count, so a change in polyphony shows up on
+	// the output within that many samples.
+	dsp::ClockDivider housekeepingDivider;
+
+	// Diagnostics, written by the engine. Frames forwarded per port, output
+	// channel count changes, and frames an output had a cable but no route,
+	// summed over all outputs.
+	PatchbayCounter framesForwarded[MAX_PATCHBAY_PORTS];
+	PatchbayCounter channelChanges;
+	PatchbayCounter unroutedFrames;
+
 	enum ParamIds {
 		NUM_PARAMS
 	};
@@ -32,58 +135,99 @@ struct PatchbayOut : Patchbay {
 	enum InputIds {
 		NUM_INPUTS
 	};
+	// followed by the other numPorts - 1 outputs
 	enum OutputIds {
-		OUTPUT_1,
-		OUTPUT_2,
-		OUTPUT_3,
-		OUTPUT_4,
-		OUTPUT_5,
-		OUTPUT_6,
-		OUTPUT_7,
-		OUTPUT_8,
-		NUM_OUTPUTS
+		OUTPUT_1
 	};
+	// followed by a green/red pair for each of the other outputs
 	enum LightIds {
 		OUTPUT_1_LIGHTG,
-		OUTPUT_1_LIGHTR,
-		OUTPUT_2_LIGHTG,
-		OUTPUT_2_LIGHTR,
-		OUTPUT_3_LIGHTG,
-		OUTPUT_3_LIGHTR,
-		OUTPUT_4_LIGHTG,
-		OUTPUT_4_LIGHTR,
-		OUTPUT_5_LIGHTG,
-		OUTPUT_5_LIGHTR,
-		OUTPUT_6_LIGHTG,
-		OUTPUT_6_LIGHTR,
-		OUTPUT_7_LIGHTG,
-		OUTPUT_7_LIGHTR,
-		OUTPUT_8_LIGHTG,
-		OUTPUT_8_LIGHTR,
-		NUM_LIGHTS
+		OUTPUT_1_LIGHTR
 	};
 
-	PatchbayOut() : Patchbay(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {
-		assert(NUM_OUTPUTS == NUM_PATCHBAY_INPUTS);
+	PatchbayOut(int numPorts) : Patchbay(numPorts, NUM_PARAMS, NUM_INPUTS, numPorts, 2 * numPorts), routedPorts(0), connectedPorts(0) {
 
-		for(int i = 0; i < NUM_PATCHBAY_INPUTS; i++) {
+		for(int i = 0; i < numPorts; i++) {
 			configOutput(i, string::f("Port %d", i + 1));
-			label[i] = "";
 			sourceIsValid[i] = false;
-			attachInputs();
-			addDestination();
+			remoteInputs[i] = NULL;
+			sourceBuffers[i] = NULL;
+			remoteSources[i] = NULL;
+		}
+
+		housekeepingDivider.setDivision(HOUSEKEEPING_DIVISION);
+
+		busChannels = std::min(numPorts, PORT_MAX_CHANNELS);
+		busPorts = (uint32_t) ((1ull << busChannels) - 1);
+	}
+
+	~PatchbayOut() {
+		removeFromRegistry();
+		applyAllCommands();
+	}
+
+	void onAdd(const AddEvent &e) override {
+		uint32_t connected = 0;
+		for(int i = 0; i < numPorts; i++) {
+			if(outputs[i].isConnected()) {
+				connected |= 1u << i;
+			}
 		}
+		connectedPorts.store(connected);
+
+		addToRegistry();
+		reclaimRetired();
 	}
 
-	rack::engine::Input getPort(std::string key) {
-		Patchbay *src = sources[key];
-		int idx = src->getIOIdx(key);
+	void onPortChange(const PortChangeEvent &e) override {
+		Patchbay::onPortChange(e);
+		if(e.type != Port::OUTPUT) return;
+
+		if(e.connecting) {
+			connectedPorts.fetch_or(1u << e.portId);
+		} else {
+			connectedPorts.fetch_and(~(1u << e.portId));
+		}
+	}
 
-		return src->inputs[idx];
+	void onRemove(const RemoveEvent &e) override {
+		removeFromRegistry();
+		// we won't be processed anymore, and the engine is locked
+		applyAllCommands();
+		reclaimRetired();
 	}
 
-	int setChannels(rack::engine::Input &input, rack::engine::Output &output) { 
-		const int channels = input.getChannels();
+	// Subscribe to our labels and resolve their sources.
+	void addToRegistry() {
+		if(registered) return;
+
+		registry.addDestination(this);
+		addRouteConsumer(&commandStats);
+		for(int i = 0; i < numPorts; i++) {
+			registry.subscribe(label[i], this, i);
+		}
+
+		registered = true;
+		attachInputs();
+	}
+
+	void removeFromRegistry() {
+		if(!registered) return;
+
+		for(int i = 0; i < numPorts; i++) {
+			registry.unsubscribe(label[i], this, i);
+			if(sourceIsValid[i]) {
+				// stop being counted as a listener, resolved again on re-add
+				removeInput(i);
+			}
+		}
+		registry.removeDestination(this);
+		removeRouteConsumer(&commandStats);
+
+		registered = false;
+	}
+
+	int setChannels(int channels, rack::engine::Output &output) { 
 		const int outChannels = output.getChannels();
 
 		if (channels != outChannels) {
@@ -103,9 +247,7 @@ struct PatchbayOut : Patchbay {
 		lights[OUTPUT_1_LIGHTR + 2*idx].setBrightness(0.f);
 	}
 
-	void setLights(rack::engine::Input &input, int idx) {
-		bool isConnected = input.isConnected();
-		
+	void setLights(bool isConnected, int idx) {
 		// the light has three states, so we have to handle isGreen & isRed separately.
 		if (isConnected) {
 			if(!isGreen[idx]) {
@@ -128,125 +270,787 @@ struct PatchbayOut : Patchbay {
 		}
 	}
 
+	// Route changes are still applied while we're bypassed, so retired
+	// sources aren't held up by us.
+	void processBypass(const ProcessArgs &args) override {
+		applyCommands();
+		Patchbay::processBypass(args);
+	}
+
 	void process(const ProcessArgs &args) override {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			if (sourceIsValid[i]  && outputs[i].isConnected()) {
-				std::string key = label[i];
-				PatchbayIn* pb = inputs[i];
-				int inputIndex = inputIdx[i];
+		PATCHBAY_PROFILE_SCOPE(PROFILE_OUT_PROCESS);
+		applyCommands();
+
+		uint32_t routed = routedPorts;
+		uint32_t active = routed & connectedPorts.load(std::memory_order_relaxed);
+		bool housekeeping = housekeepingDivider.process();
+
+		// polled even without a cable, to keep their rings drained
+		uint32_t remote = routed & remotePorts;
+		while(remote) {
+			int i = __builtin_ctz(remote);
+			remote &= remote - 1;
+			remoteSources[i]->poll(args.frame);
+		}
+
+		if(collectDiagnostics.load(std::memory_order_relaxed)) {
+			countFrame(routed, active);
+		}
 
-				rack::engine::Input input = pb->inputs[inputIndex];
+		if(busActive) {
+			processBus(routed & 1, args.frame, housekeeping);
+			active &= ~busPorts;
+		}
+
+		uint32_t slow = active & slowPorts;
+		active &= ~slowPorts;
+
+		while(active) {
+			int i = __builtin_ctz(active);
+			active &= active - 1;
+			processPort(i, args.frame, housekeeping);
+		}
+
+		if(slow) {
+			processSlowPorts(slow, args.frame);
+		}
+	}
+
+	void countFrame(uint32_t routed, uint32_t active) {
+		uint32_t connected = connectedPorts.load(std::memory_order_relaxed);
+		unroutedFrames.add(__builtin_popcount(connected & ~routed));
+
+		while(active) {
+			int i = __builtin_ctz(active);
+			active &= active - 1;
+			framesForwarded[i].add();
+		}
+	}
 
-				int channels = setChannels(input, outputs[i]);
+	void getCounters(PatchbayCounterList &counters) override {
+		Patchbay::getCounters(counters);
+		counters.push_back(std::make_pair("channel_changes", channelChanges.get()));
+		counters.push_back(std::make_pair("unrouted_frames", unroutedFrames.get()));
+		for(int i = 0; i < numPorts; i++) {
+			counters.push_back(std::make_pair(string::f("port%d_frames_forwarded", i + 1), framesForwarded[i].get()));
+		}
+		for(int i = 0; i < numPorts; i++) {
+			RemoteSource *remote = remoteInputs[i];
+			if(remote) {
+				counters.push_back(std::make_pair(string::f("port%d_remote_latency", i + 1), remote->latency.load()));
+				counters.push_back(std::make_pair(string::f("port%d_remote_underruns", i + 1), remote->underruns.load()));
+				counters.push_back(std::make_pair(string::f("port%d_remote_skipped", i + 1), remote->skipped.load()));
+			}
+		}
+	}
+
+	// setChannels() for the engine thread, counting changes.
+	void updateChannels(int channels, rack::engine::Output &output) {
+		if(collectDiagnostics.load(std::memory_order_relaxed) && channels != output.getChannels()) {
+			channelChanges.add();
+		}
+		setChannels(channels, output);
+	}
 
-				for(int c = 0; c < channels; c++) {
-					int voltage = input.getVoltage(c);
-					outputs[i].setVoltage(voltage, c);
+	// Copy the frame routed to port i into dst, return its channel count.
+	inline int readSource(int i, int64_t frame, float *dst) {
+		const PortBuffer *buffer = sourceBuffers[i];
+		// the ring already holds remote frames back, see SharedTransport.hpp
+		if(!buffer) {
+			return remoteSources[i]->read(frame, dst);
+		}
+
+		return engineDelayed
+			? buffer->readPrevious(frame, dst)
+			: buffer->readLatest(frame, dst);
+	}
+
+	// Forward one resolved route.
+	inline void processPort(int i, int64_t frame, bool housekeeping) {
+		int channels = readSource(i, frame, outputs[i].voltages);
+
+		if(housekeeping) {
+			updateChannels(channels, outputs[i]);
+			setLights(channels > 0, i);
+		}
+	}
+
+	// Forward the ports running below audio rate. Divisions are powers of
+	// two, so all ports with the same one are read on the same frames.
+	void processSlowPorts(uint32_t slow, int64_t frame) {
+		while(slow) {
+			int i = __builtin_ctz(slow);
+			slow &= slow - 1;
+
+			const PortRate &rate = engineRates[i];
+			bool update = (frame & (rate.division - 1)) == 0;
+			float *voltages = outputs[i].voltages;
+
+			if(!rate.linear) {
+				if(update) {
+					int channels = readSource(i, frame, voltages);
+					updateChannels(channels, outputs[i]);
+					setLights(channels > 0, i);
 				}
-				
-				setLights(input, i);
+				continue;
+			}
+
+			if(update) {
+				float target[PORT_MAX_CHANNELS] = {};
+				int channels = readSource(i, frame, target);
+				int rounded = (channels + 3) & ~3;
+				// the source is copied in groups of 4, the ramp mustn't pick up
+				// whatever it has beyond its channel count
+				for(int c = channels; c < rounded; c++) {
+					target[c] = 0.f;
+				}
+				// channels the output didn't have yet start at their target
+				// instead of ramping from stale voltages
+				for(int c = outputs[i].getChannels(); c < rounded; c++) {
+					voltages[c] = target[c];
+				}
+				updateChannels(channels, outputs[i]);
+				setLights(channels > 0, i);
+
+				simd::float_4 scale = 1.f / rate.division;
+				for(int c = 0; c < channels; c += 4) {
+					simd::float_4 step = (simd::float_4::load(target + c) - simd::float_4::load(voltages + c)) * scale;
+					step.store(rampSteps[i] + c);
+				}
+				rampChannels[i] = channels;
+			}
+
+			for(int c = 0; c < rampChannels[i]; c += 4) {
+				(simd::float_4::load(voltages + c) + simd::float_4::load(rampSteps[i] + c)).store(voltages + c);
 			}
 		}
-	};
+	}
 
-	json_t* dataToJson() override {
-		json_t *data = json_object();
+	// Split the route of port 1 into mono outputs.
+	void processBus(bool isRouted, int64_t frame, bool housekeeping) {
+		int channels = 0;
+
+		if(isRouted) {
+			float bus[PORT_MAX_CHANNELS];
+			channels = readSource(0, frame, bus);
+
+			uint32_t active = connectedPorts.load(std::memory_order_relaxed) & busPorts;
+			while(active) {
+				int j = __builtin_ctz(active);
+				active &= active - 1;
+				outputs[j].voltages[0] = j < channels ? bus[j] : 0.f;
+			}
+		}
+
+		if(housekeeping) {
+			for(int j = 0; j < busChannels; j++) {
+				if(isRouted) {
+					updateChannels(j < channels ? 1 : 0, outputs[j]);
+					setLights(j < channels, j);
+				} else if(j > 0) {
+					// port 1 is handled by removeInput()
+					updateChannels(0, outputs[j]);
+					clearLights(j);
+				}
+			}
+		}
+	}
+
+	void setUnbundle(bool unbundle) {
+		this->unbundle = unbundle;
+		touchLabel(0);
+
+		Command c;
+		c.type = Command::SET_UNBUNDLE;
+		c.port = 0;
+		c.buffer = NULL;
+		c.value = unbundle;
+		pushCommand(c);
+	}
+
+	void setDelayedTransport(bool delayedTransport) {
+		this->delayedTransport = delayedTransport;
+
+		Command c;
+		c.type = Command::SET_DELAYED;
+		c.port = 0;
+		c.value = delayedTransport;
+		pushCommand(c);
+	}
+
+	// Set the rate port idx is forwarded at, see PortRate.
+	void setRate(int idx, int division, bool linear) {
+		if(division < 1 || (division & (division - 1))) {
+			// not a power of two
+			division = 1;
+		}
+		rates[idx].division = division;
+		rates[idx].linear = division > 1 && linear;
+
+		Command c;
+		c.type = Command::SET_RATE;
+		c.port = idx;
+		c.value = rates[idx].division;
+		c.linear = rates[idx].linear;
+		pushCommand(c);
+	}
+
+	// Queue a route change for the engine. If the queue is full the command
+	// waits in overflowCommands, which is flushed by the widget and before
+	// every push, so commands are always applied in order.
+	void pushCommand(Command c) {
+		c.seq = getRouteCommandSeq()++;
+		commandStats.pushed++;
+		flushCommands();
+		if(!overflowCommands.empty() || !commands.push(c)) {
+			overflowCommands.push_back(c);
+		}
+	}
+
+	void flushCommands() {
+		while(!overflowCommands.empty() && commands.push(overflowCommands.front())) {
+			overflowCommands.pop_front();
+		}
+	}
+
+	// Engine thread, or any thread while we're not being processed.
+	void applyCommands() {
+		Command c;
+		while(commands.pop(c)) {
+			applyCommand(c);
+		}
+	}
+
+	// Apply everything queued, including overflow. Only while we're not being
+	// processed.
+	void applyAllCommands() {
+		do {
+			flushCommands();
+			applyCommands();
+		} while(!overflowCommands.empty());
+	}
+
+	void applyCommand(const Command &c) {
+		switch(c.type) {
+			case Command::SET_ROUTE:
+				sourceBuffers[c.port] = c.buffer;
+				remoteSources[c.port] = c.remote;
+				if(c.remote) {
+					remotePorts |= 1u << c.port;
+				} else {
+					remotePorts &= ~(1u << c.port);
+				}
+				routedPorts |= 1u << c.port;
+				// what the source published last, in bus mode too, and the
+				// frame about to be read sets it for sure: housekeeping runs
+				// on this frame
+				setChannels(c.remote ? c.remote->getChannels() : c.buffer->getChannels(), outputs[c.port]);
+				clearLights(c.port);
+				housekeepingDivider.clock = HOUSEKEEPING_DIVISION - 1;
+				break;
+
+			case Command::CLEAR_ROUTE:
+				routedPorts &= ~(1u << c.port);
+				remotePorts &= ~(1u << c.port);
+				sourceBuffers[c.port] = NULL;
+				remoteSources[c.port] = NULL;
+				outputs[OUTPUT_1 + c.port].setChannels(0);
+				clearLights(c.port);
+				break;
+
+			case Command::SET_RATE:
+				engineRates[c.port].division = c.value;
+				engineRates[c.port].linear = c.linear;
+				rampChannels[c.port] = 0;
+				if(c.value > 1) {
+					slowPorts |= 1u << c.port;
+				} else {
+					slowPorts &= ~(1u << c.port);
+				}
+				break;
+
+			case Command::SET_DELAYED:
+				engineDelayed = c.value;
+				break;
+
+			case Command::SET_UNBUNDLE:
+				busActive = c.value;
+				if(!busActive) {
+					// the bus outputs without a route of their own go quiet,
+					// the others are picked up by process() again
+					for(int j = 1; j < busChannels; j++) {
+						if(!(routedPorts & (1u << j))) {
+							outputs[j].setChannels(0);
+							clearLights(j);
+						}
+					}
+				}
+				break;
+		}
 
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			// Create a character array to hold the concatenated string
-			char buffer[16]; // Adjust the size as needed
+		commandStats.appliedSeq.store(c.seq, std::memory_order_release);
+		commandStats.applied.fetch_add(1, std::memory_order_release);
+	}
 
-			// Use snprintf to format the combination
-			snprintf(buffer, sizeof(buffer), "label%d", i);
+	// The modules output idx is patched into.
+	std::string describeCables(int idx) override {
+		std::string text;
+		app::ModuleWidget *mw = APP->scene->rack->getModule(id);
+		if(!mw) return text;
+
+		for(app::CableWidget *cw : APP->scene->rack->getCompleteCablesOnPort(mw->getOutput(idx))) {
+			// This is always an output, so always say "To"
+			text += "\n";
+			text += "To ";
+			text += cw->inputPort->module->model->getFullName();
+			text += ": ";
+			text += cw->inputPort->getPortInfo()->getName();
+			text += " ";
+			text += "input";
+		}
+		return text;
+	}
+
+	// The PatchbayIn port whose input ends up on output idx, or NULL. In
+	// unbundle mode the bus outputs come from port 1's route, and if that's a
+	// PatchbayIn in bus mode, from the input with the same number. Remote
+	// routes have no PatchbayIn in this instance.
+	PatchbayIn *getUpstream(int idx, int *upstreamIdx) {
+		int route = isBusLane(idx) ? 0 : idx;
+		if(!sourceIsValid[route] || remoteInputs[route]) return NULL;
+
+		PatchbayIn *source = inputs[route];
+		*upstreamIdx = inputIdx[route];
+		if(unbundle && idx < busChannels && *upstreamIdx == 0 && source->busMode.load()) {
+			*upstreamIdx = idx;
+		}
+		return source;
+	}
 
-			// The buffer now contains the concatenated C-style string
-			const char* key = buffer;
-			json_object_set_new(data, key, json_string(label[i].c_str()));
+	// Bump the label generation of port idx. The bus outputs display the label
+	// of port 1, so they're bumped along with it.
+	void touchLabel(int idx) {
+		labelGeneration[idx]++;
+		if(idx == 0) {
+			for(int j = 1; j < busChannels; j++) {
+				labelGeneration[j]++;
+			}
 		}
+	}
+
+	// Whether output idx is fed from the bus rather than its own label.
+	bool isBusLane(int idx) {
+		return unbundle && idx > 0 && idx < busChannels;
+	}
+
+	json_t* dataToJson() override {
+		json_t *data = json_object();
+
+		labelsToJson(data);
+		json_object_set_new(data, "delayedTransport", json_boolean(delayedTransport));
+		json_object_set_new(data, "unbundle", json_boolean(unbundle));
+		json_object_set_new(data, "receiveRemote", json_boolean(receiveRemote));
+
+		json_t *rates_json = json_array();
+		for(int i = 0; i < numPorts; i++) {
+			json_t *rate_json = json_object();
+			json_object_set_new(rate_json, "division", json_integer(rates[i].division));
+			json_object_set_new(rate_json, "linear", json_boolean(rates[i].linear));
+			json_array_append_new(rates_json, rate_json);
+		}
+		json_object_set_new(data, "rates", rates_json);
 
 		return data;
 
 	}
 
 	void dataFromJson(json_t* root) override {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			// Create a character array to hold the concatenated string
-			char buffer[16]; // Adjust the size as needed
+		PATCHBAY_PROFILE_SCOPE(PROFILE_DATA_FROM_JSON);
+		// before the labels, which are resolved with it
+		json_t *remote_json = json_object_get(root, "receiveRemote");
+		if(remote_json) {
+			setReceiveRemote(json_is_true(remote_json));
+		}
 
-			// Use snprintf to format the combination
-			snprintf(buffer, sizeof(buffer), "label%d", i);
+		json_t *labels_json = labelsFromJson(root);
+		for(int i=0; i  < numPorts; i++) {
+			json_t *label_json = labelFromJson(root, labels_json, i);
 
-			// The buffer now contains the concatenated C-style string
-			const char* key = buffer;
+			if(json_is_string(label_json)) {
+				setLabel(i, registry.intern(json_string_value(label_json)));
+			}
+		}
 
-			json_t *label_json = json_object_get(root, key);
+		json_t *delayed_json = json_object_get(root, "delayedTransport");
+		if(delayed_json) {
+			setDelayedTransport(json_is_true(delayed_json));
+		}
 
-			if(json_is_string(label_json)) {
-				label[i] = json_string_value(label_json);
+		json_t *unbundle_json = json_object_get(root, "unbundle");
+		if(unbundle_json) {
+			setUnbundle(json_is_true(unbundle_json));
+		}
+
+		json_t *rates_json = json_object_get(root, "rates");
+		for(int i = 0; i < numPorts && i < (int) json_array_size(rates_json); i++) {
+			json_t *rate_json = json_array_get(rates_json, i);
+			json_t *division_json = json_object_get(rate_json, "division");
+			if(json_is_integer(division_json)) {
+				setRate(i, json_integer_value(division_json), json_is_true(json_object_get(rate_json, "linear")));
 			}
 		}
+	}
 
-		attachInputs();
-		addDestination();
+	// Select the label of port idx, keeping the registry's subscriber index in
+	// sync, and resolve its source.
+	void setLabel(int idx, LabelHandle lbl) {
+		if(!registered) {
+			// resolved in addToRegistry()
+			replaceLabel(idx, lbl);
+			touchLabel(idx);
+			return;
+		}
+
+		registry.unsubscribe(label[idx], this, idx);
+		replaceLabel(idx, lbl);
+		touchLabel(idx);
+		registry.subscribe(lbl, this, idx);
+		attachInput(idx);
+	}
+
+	void attachInput(int idx) {
+		if(sourceExists(label[idx])) {
+			const LabelRegistry::Source &src = registry.getSource(label[idx]);
+			setInput(idx, src.module, src.port);
+		} else if(attachRemote(idx)) {
+			// routed from another instance
+		} else if(sourceIsValid[idx]) {
+			// label was cleared or its source went away
+			removeInput(idx);
+		}
 	}
 
 	void attachInputs() {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			std::string key = label[i];
+		PATCHBAY_PROFILE_SCOPE(PROFILE_ATTACH_INPUTS);
+		for(int i=0; i  < numPorts; i++) {
+			attachInput(i);
+		}
+	}
+
+	// Route port idx from another instance sharing its label, if we may.
+	// Return whether it is.
+	bool attachRemote(int idx) {
+		if(!receiveRemote || label[idx] == NO_LABEL) return false;
+
+		std::string name = getLabelText(idx);
+		if(remoteInputs[idx] && remoteInputs[idx]->label == name) return true;
+
+		RemoteSource *remote = acquireRemoteSource(name);
+		if(!remote) return false;
 
-			if(sourceExists(key)){
-				PatchbayIn* input = dynamic_cast<PatchbayIn*>(sources[key]);
-				int input_Idx = input->getIOIdx(key);
-				setInput(i, input, input_Idx);
+		setRemoteInput(idx, remote);
+		return true;
+	}
+
+	void setReceiveRemote(bool receiveRemote) {
+		this->receiveRemote = receiveRemote;
+		if(!registered) return;
+
+		for(int i = 0; i < numPorts; i++) {
+			if(receiveRemote) {
+				attachInput(i);
+			} else if(remoteInputs[i]) {
+				removeInput(i);
 			}
 		}
 	}
 
-	void setInput(int idx, PatchbayIn* pbIn, int input_Idx) {
-		inputs[idx] = pbIn;
-		inputIdx[idx] = input_Idx;
-		sourceIsValid[idx] = true;
-
-		rack::engine::Input in = pbIn->inputs[input_Idx];
-		setChannels(in, outputs[idx]);
+	// Drop remote routes whose writer went away, and pick up labels other
+	// instances started sharing. Called periodically by the widget.
+	void refreshRemoteInputs() {
+		if(!registered || !receiveRemote) return;
 
-		clearLights(idx);
+		for(int i = 0; i < numPorts; i++) {
+			if(remoteInputs[i] && !remoteInputs[i]->isAlive()) {
+				removeInput(i);
+			}
+			if(!sourceIsValid[i]) {
+				attachRemote(i);
+			}
+		}
 	}
 
-	void addDestination() {
-		for(int i=0; i  < NUM_PATCHBAY_INPUTS; i++) {
-			// each PatchbayOut is a destination with it's own unique key
-			std::string key = getLabel();
-			moduleId = key;
-			destinations[key] = this; 
+	// Let go of the current source of port idx. The engine may still read it
+	// until the next route command for the port is applied.
+	void releaseSource(int idx) {
+		if(!sourceIsValid[idx]) return;
+
+		if(remoteInputs[idx]) {
+			releaseRemoteSource(remoteInputs[idx]);
+			remoteInputs[idx] = NULL;
+		} else {
+			inputs[idx]->removeListener(inputIdx[idx]);
 		}
 	}
 
-	void removeInput(int idx) {
-		sourceIsValid[idx] = false;
+	void setRemoteInput(int idx, RemoteSource *remote) {
+		if(collectDiagnostics) attachCalls.add();
 
-		outputs[OUTPUT_1 + idx].setChannels(0);
+		releaseSource(idx);
+		inputs[idx] = NULL;
+		inputIdx[idx] = 0;
+		remoteInputs[idx] = remote;
+		sourceIsValid[idx] = true;
+		touchLabel(idx);
 
-		clearLights(idx);
+		Command c;
+		c.type = Command::SET_ROUTE;
+		c.port = idx;
+		c.remote = remote;
+		pushCommand(c);
 	}
+
+	void setInput(int idx, Patchbay* pbIn, int input_Idx) override {
+		if(collectDiagnostics) attachCalls.add();
+
+		// only PatchbayIn modules register themselves as sources
+		PatchbayIn *source = static_cast<PatchbayIn*>(pbIn);
+		// count the new listener first, so rerouting to the same port never
+		// stops it from being published
+		source->addListener(input_Idx);
+		releaseSource(idx);
+
+		inputs[idx] = source;
+		inputIdx[idx] = input_Idx;
+		sourceIsValid[idx] = true;
+		touchLabel(idx);
+
+		Command c;
+		c.type = Command::SET_ROUTE;
+		c.port = idx;
+		c.buffer = &source->buffers[input_Idx];
+		pushCommand(c);
+	}
+
+	void removeInput(int idx) override {
+		if(!sourceIsValid[idx]) return;
+		if(collectDiagnostics) detachCalls.add();
+
+		releaseSource(idx);
+		sourceIsValid[idx] = false;
+		touchLabel(idx);
+
+		Command c;
+		c.type = Command::CLEAR_ROUTE;
+		c.port = idx;
+		c.buffer = NULL;
+		c.value = 0;
+		pushCommand(c);
+	}
+};
+
+// PatchbayOut with a fixed port count, for createModel(). process() only
+// visits active routes, so unlike PatchbayInModule it has nothing to unroll.
+template <int PORTS>
+struct PatchbayOutModule : PatchbayOut {
+	PatchbayOutModule() : PatchbayOut(PORTS) {}
 };
 
 // these have to be forward-declared here to make the implementation of step() possible, see cpp for details
 struct PatchbayOutPortWidget;
 struct PatchbayOutPortTooltip : ui::Tooltip {
 	PatchbayOutPortWidget* portWidget;
+
+	// what the text was last built from
+	struct {
+		int channels = -1;
+		int32_t millivolts[PORT_MAX_CHANNELS];
+		PatchbayIn* source = NULL;
+		int sourceIdx = 0;
+		uint32_t labelGeneration = 0;
+		uint32_t cableGeneration = 0;
+		uint32_t sourceCableGeneration = 0;
+	} shown;
+
 	void step() override;
+	void buildText(PatchbayOut* mod, int idx, PatchbayIn* inputPatchbay, int upstreamIdx);
 };
 
-std::map<std::string, Patchbay*> Patchbay::destinations = {};
-
+// Labels are kept by name, a handle may be released and reused for another
+// label while the menu is open.
 struct PatchbayLabelMenuItem : MenuItem {
-	PatchbayOut *module;
+	int64_t moduleId;
 	std::string label;
 	int idx;
 	void onAction(const event::Action &e) override {
-		module->label[idx] = label;
-		module->attachInputs();
+		PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+		if(module) {
+			module->setLabel(idx, module->registry.intern(label));
+		}
+	}
+};
+
+inline PatchbayLabelMenuItem *createPatchbayLabelMenuItem(PatchbayOut *module, int idx, LabelHandle label) {
+	PatchbayLabelMenuItem *item = new PatchbayLabelMenuItem();
+	item->moduleId = module->id;
+	item->idx = idx;
+	item->label = module->registry.name(label);
+	item->text = item->label;
+	item->rightText = CHECKMARK(label == module->label[idx]);
+	return item;
+}
+
+// Type-ahead filter at the top of the source selector menu. Without a filter
+// the sources are grouped by PatchbayIn module, behind a submenu that lists
+// the groups when opened, each group a submenu that is only built when opened. With a filter, labels starting with it are listed
+// directly, up to MAX_RESULTS of them. Either way the cost of the menu doesn't
+// grow with the number of labels.
+struct PatchbaySourceFilterField : ui::TextField {
+	static const size_t MAX_RESULTS = 32;
+
+	int64_t moduleId;
+	int idx;
+	Menu *menu;
+	// menu entries below the field, replaced when the filter changes
+	std::vector<Widget*> results;
+	std::string firstMatch;
+
+	void onChange(const event::Change &e) override {
+		updateResults();
+	}
+
+	void onAction(const event::Action &e) override {
+		// enter picks the first match
+		PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+		if(module && !firstMatch.empty()) {
+			module->setLabel(idx, module->registry.intern(firstMatch));
+		}
+		MenuOverlay *overlay = getAncestorOfType<MenuOverlay>();
+		if(overlay) {
+			overlay->requestDelete();
+		}
+		e.consume(this);
+	}
+
+	void addResult(Widget *w) {
+		menu->addChild(w);
+		results.push_back(w);
+	}
+
+	void updateResults() {
+		// The menu may point at the entries we're about to delete: the one
+		// under the mouse, and the group whose submenu is open.
+		if(std::find(results.begin(), results.end(), menu->activeEntry) != results.end()) {
+			menu->setChildMenu(NULL);
+			menu->activeEntry = NULL;
+		}
+		for(Widget *w : results) {
+			menu->removeChild(w);
+			delete w;
+		}
+		results.clear();
+		firstMatch.clear();
+
+		PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+		if(!module) {
+			addResult(construct<MenuLabel>(&MenuLabel::text, "Module was removed"));
+			return;
+		}
+
+		if(text.empty()) {
+			addModuleGroups(module);
+			return;
+		}
+
+		LabelRegistry &registry = module->registry;
+		size_t begin, end;
+		registry.findSourcesByPrefix(text, &begin, &end);
+		const std::vector<LabelHandle> &sorted = registry.getSortedSources();
+
+		if(begin == end) {
+			addResult(construct<MenuLabel>(&MenuLabel::text, "No matching sources"));
+			return;
+		}
+
+		firstMatch = registry.name(sorted[begin]);
+		for(size_t i = begin; i < end && i < begin + MAX_RESULTS; i++) {
+			addResult(createPatchbayLabelMenuItem(module, idx, sorted[i]));
+		}
+		if(end - begin > MAX_RESULTS) {
+			addResult(construct<MenuLabel>(&MenuLabel::text, string::f("%d more, keep typing", (int) (end - begin - MAX_RESULTS))));
+		}
+	}
+
+	// Only the entry for the groups is added here, they're listed when it's
+	// opened. With more than MAX_RESULTS modules they're paged, so no level of
+	// the menu holds an entry per module.
+	void addModuleGroups(PatchbayOut *module) {
+		// copied for the lambdas below, which may run after we and the
+		// modules are gone
+		int64_t outId = moduleId;
+		int port = idx;
+
+		int count = (int) module->registry.sourceModules.size();
+		if(count == 0) {
+			addResult(construct<MenuLabel>(&MenuLabel::text, "No sources"));
+			return;
+		}
+		addResult(createSubmenuItem(string::f("By module (%d)", count), "", [=](Menu *submenu) {
+			appendModuleGroups(submenu, outId, port);
+		}));
+	}
+
+	// one submenu per PatchbayIn, named after its first published label
+	static void appendModuleGroups(Menu *menu, int64_t outId, int port) {
+		PatchbayOut *out = findPatchbayModule<PatchbayOut>(outId);
+		if(!out) {
+			return;
+		}
+		typedef std::vector<std::pair<std::string, int64_t>> GroupList;
+		GroupList groups;
+		for(Patchbay *source : out->registry.sourceModules) {
+			groups.push_back(std::make_pair(source->getLabelText(0), source->id));
+		}
+		std::sort(groups.begin(), groups.end());
+
+		if(groups.size() <= MAX_RESULTS) {
+			appendGroupItems(menu, outId, port, groups);
+			return;
+		}
+		for(size_t begin = 0; begin < groups.size(); begin += MAX_RESULTS) {
+			GroupList page(groups.begin() + begin, groups.begin() + std::min(begin + MAX_RESULTS, groups.size()));
+			std::string title = string::f("%s ... %s", page.front().first.c_str(), page.back().first.c_str());
+			menu->addChild(createSubmenuItem(title, "", [=](Menu *submenu) {
+				appendGroupItems(submenu, outId, port, page);
+			}));
+		}
+	}
+
+	static void appendGroupItems(Menu *menu, int64_t outId, int port, const std::vector<std::pair<std::string, int64_t>> &groups) {
+		for(auto &group : groups) {
+			int64_t sourceId = group.second;
+			Patchbay *source = findPatchbayModule<Patchbay>(sourceId);
+			if(!source) {
+				// removed since the list was made
+				continue;
+			}
+			std::string title = string::f("%s (%s...)", source->model->getFullName().c_str(), group.first.c_str());
+
+			menu->addChild(createSubmenuItem(title, "", [=](Menu *submenu) {
+				PatchbayOut *out = findPatchbayModule<PatchbayOut>(outId);
+				Patchbay *source = findPatchbayModule<Patchbay>(sourceId);
+				if(!out || !source || !out->registry.hasSourceModule(source)) {
+					// removed while the menu was open
+					return;
+				}
+				LabelRegistry &registry = out->registry;
+				for(int i = 0; i < source->numPorts; i++) {
+					if(registry.getSource(source->label[i]).module == source) {
+						submenu->addChild(createPatchbayLabelMenuItem(out, port, source->label[i]));
+					}
+				}
+			}));
+		}
 	}
 };
 
@@ -254,51 +1058,94 @@ struct PatchbaySourceSelectorTextBox : HoverableTextBox, PatchbayLabelDisplay {
 	PatchbayOut *module;
 	int idx;
 
+	// module->labelGeneration[idx] the display was last updated for
+	uint32_t generation = UINT32_MAX;
+
 	PatchbaySourceSelectorTextBox() : HoverableTextBox() {}
 
 	void onAction(const event::Action &e) override {
+		if(module->isBusLane(idx)) {
+			// fed from port 1, nothing to select
+			return;
+		}
+
 		// based on AudioDeviceChoice::onAction in src/app/AudioWidget.cpp
 		Menu *menu = createMenu();
 		menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Select source"));
 
+		PatchbaySourceFilterField *filter = new PatchbaySourceFilterField();
+		filter->moduleId = module->id;
+		filter->idx = idx;
+		filter->menu = menu;
+		filter->placeholder = "Search labels";
+		filter->box.size.x = 150;
+		menu->addChild(filter);
+
 		{
 			PatchbayLabelMenuItem *item = new PatchbayLabelMenuItem();
-			item->module = module;
+			item->moduleId = module->id;
 			item->idx = idx;
-			item->label = "";		
 			item->text = "(none)";
-			item->rightText = CHECKMARK(module->label[idx].empty());
+			item->rightText = CHECKMARK(module->label[idx] == NO_LABEL);
 			menu->addChild(item);
 		}
 
-		for (int i=0; i < NUM_PATCHBAY_INPUTS; i++) {
-			if(!module->sourceIsValid[i] && !module->label[i].empty()) {
+		for (int i=0; i < module->numPorts; i++) {
+			if(!module->sourceIsValid[i] && module->label[i] != NO_LABEL) {
 				// the source of the module doesn't exist, it shouldn't appear in sources, so display it as unavailable
 				PatchbayLabelMenuItem *item = new PatchbayLabelMenuItem();
-				item->module = module;
+				item->moduleId = module->id;
 				item->idx = idx;
-				item->label = module->label[i];
-				item->text = module->label[i];
+				item->label = module->getLabelText(i);
+				item->text = module->getLabelText(i);
 				item->text += " (missing)";
 				item->rightText = CHECKMARK("true");
 				menu->addChild(item);
 			}
 		}
 
-		auto src = module->sources;
+#ifdef PATCHBAY_SHARED_TRANSPORT
+		if(module->receiveRemote) {
+			appendRemoteLabels(menu);
+		}
+#endif
 
-		for(auto it = src.begin(); it != src.end(); it++) {
-			// int idx = it->second->getInputIdx(it->first);
+		menu->addChild(new MenuSeparator);
+		filter->updateResults();
+		APP->event->setSelectedWidget(filter);
+	}
 
-			PatchbayLabelMenuItem *item = new PatchbayLabelMenuItem();
-			
-			item->module = module;
-			item->idx = idx;
-			item->label = it->first;
-			item->text = it->first;
-			item->rightText = CHECKMARK(item->label == module->label[idx]);
-			menu->addChild(item);
-		}
+	// Labels shared by other instances and not published in this one, listed
+	// when the submenu is opened.
+	void appendRemoteLabels(Menu *menu) {
+		// copied for the lambdas below, which may run after we and the
+		// module are gone
+		int64_t outId = module->id;
+		int port = idx;
+
+		menu->addChild(createSubmenuItem("Other Rack instances", "", [=](Menu *submenu) {
+			PatchbayOut *out = findPatchbayModule<PatchbayOut>(outId);
+			if(!out) return;
+			LabelRegistry &registry = out->registry;
+			std::vector<std::string> labels = listSharedLabels();
+			std::sort(labels.begin(), labels.end());
+
+			for(const std::string &name : labels) {
+				if(registry.hasSource(registry.find(name))) {
+					// shared by this instance
+					continue;
+				}
+				submenu->addChild(createMenuItem(name, CHECKMARK(out->getLabelText(port) == name), [=]() {
+					PatchbayOut *out = findPatchbayModule<PatchbayOut>(outId);
+					if(out) {
+						out->setLabel(port, out->registry.intern(name));
+					}
+				}));
+			}
+			if(submenu->children.empty()) {
+				submenu->addChild(construct<MenuLabel>(&MenuLabel::text, "No shared labels"));
+			}
+		}));
 	}
 
 	void onButton(const event::Button &e) override {
@@ -313,10 +1160,21 @@ struct PatchbaySourceSelectorTextBox : HoverableTextBox, PatchbayLabelDisplay {
 	}
 
 	void step() override {
+		if(module && module->labelGeneration[idx] != generation) {
+			generation = module->labelGeneration[idx];
+			updateText();
+		}
 		HoverableTextBox::step();
-		if(!module) return;
-		setText(module->label[idx]);
-		textColor = module->sourceIsValid[idx] ? defaultTextColor : errorTextColor;
+	}
+
+	void updateText() {
+		if(module->isBusLane(idx)) {
+			setText(string::f("%s:%d", module->getLabelText(0).c_str(), idx + 1));
+			setTextColor(module->sourceIsValid[0] ? defaultTextColor : errorTextColor);
+			return;
+		}
+		setText(module->getLabelText(idx));
+		setTextColor(module->sourceIsValid[idx] ? defaultTextColor : errorTextColor);
 	}
 };
 
@@ -397,104 +1255,42 @@ void PatchbayOutPortTooltip::step() {
 	// the incoming signal at the other end of the Patchbay if applicable.
 
 	if (portWidget->module) {
-
-		// The final tooltip text is going to have these four parts.
-		std::string labelText = "";
-		std::string description = ""; // Note: PatchbayOutPortWidget doesn't actually have a description, but this is here for completeness anyway.
-		std::string voltageText = "";
-		std::string cableText = "";
+		PatchbayOut* mod = dynamic_cast<PatchbayOut*>(portWidget->module);
+		int idx = portWidget->portId;
 
 		// find out the corresponding Patchbay input
-		// PatchbayOut* mod = dynamic_cast<PatchbayOut*>(portWidget->module);
-		// PatchbayIn* inputPatchbay = NULL;
-		// if(mod && mod->sourceExists(mod->label[portWidget->idx])) {
-		// 	inputPatchbay = mod->sources[mod->label[portWidget->idx]];
-		// }
+		int upstreamIdx = 0;
+		PatchbayIn* inputPatchbay = mod->getUpstream(idx, &upstreamIdx);
 
 		engine::Port* port = portWidget->getPort();
-		engine::PortInfo* portInfo = portWidget->getPortInfo();
+		int channels = port->getChannels();
 
-		description = portInfo->getDescription();
+		// Only rebuild the text when something it shows has changed: the
+		// voltages at display precision, the route or the cables at either end.
+		bool changed = channels != shown.channels
+			|| inputPatchbay != shown.source
+			|| upstreamIdx != shown.sourceIdx
+			|| mod->labelGeneration[idx] != shown.labelGeneration
+			|| mod->cableGeneration.load() != shown.cableGeneration
+			|| (inputPatchbay && inputPatchbay->cableGeneration.load() != shown.sourceCableGeneration);
 
-		// Get voltage text based on the number of channels
-		int channels = port->getChannels();
+		int32_t millivolts[PORT_MAX_CHANNELS];
 		for (int i = 0; i < channels; i++) {
-			float v = port->getVoltage(i);
-			// Add newline or comma
-			voltageText += "\n";
-			if (channels > 1)
-				voltageText += string::f("%d: ", i + 1);
-			voltageText += string::f("% .3fV", math::normalizeZero(v));
-		}
-
-		labelText = portInfo->getFullName();
-
-		// Find the relevant cables: the cable going out of this port and the
-		// cable of the corresponding port on the other end of the Patchbay. We
-		// iterate over all cables, but that's fine, getCompleteCablesOnPort
-		// would do that anyway.
-		// for (widget::Widget* w : APP->scene->rack->getCableContainer()->children) {
-		// 	CableWidget* cw = dynamic_cast<CableWidget*>(w);
-
-		// 	if(!cw->isComplete())
-		// 		continue;
-
-			// if(cw->outputPort == portWidget) {
-			// 	// we've found a cable that is outgoing from this port
-			// 	// we know that the portWidget is always an output, so otherPw will be the cable input port.
-			// 	PortWidget* otherPw = cw->inputPort;
-			// 	if(!otherPw)
-			// 		continue;
-
-			// 	cableText += "\n";
-			// 	// This widget is always instantiated on an output, so always say "To"
-			// 	cableText += "To ";
-			// 	cableText += otherPw->module->model->getFullName();
-			// 	cableText += ": ";
-			// 	cableText += otherPw->getPortInfo()->getName();
-			// 	cableText += " ";
-			// 	cableText += "input";
-
-	// 		} else if(inputPatchbay
-	// 		   && cw->inputPort
-	// 		   && cw->outputPort
-	// 		   && cw->inputPort->module == inputPatchbay
-	// 		   && cw->inputPort->portId == portWidget->portId
-	// 		  ) {
-	// 			// cable is incoming to the other end of the corresponding
-	// 			// Patchbay input, snag the label from it
-	// 			labelText += "\n";
-	// 			labelText += "Patchbaying from ";
-	// 			labelText += cw->outputPort->module->model->getFullName();
-	// 			labelText += ": ";
-	// 			labelText += cw->outputPort->getPortInfo()->getName();
-	// 			labelText += " ";
-	// 			labelText += "output";
-
-	// 		} else {
-	// 			continue;
-	// 		}
-
-		// }
-
-		// Assemble the final tooltip text.
-		text = labelText;
-
-		if(description != "") {
-			text += "\n";
-			text += description;
+			millivolts[i] = (int32_t) std::round(port->getVoltage(i) * 1000.f);
+			changed = changed || millivolts[i] != shown.millivolts[i];
 		}
 
-		if(voltageText != "") {
-			// voltageText already starts with newline
-			text += voltageText;
-		}
+		if(changed) {
+			shown.channels = channels;
+			shown.source = inputPatchbay;
+			shown.sourceIdx = upstreamIdx;
+			shown.labelGeneration = mod->labelGeneration[idx];
+			shown.cableGeneration = mod->cableGeneration.load();
+			shown.sourceCableGeneration = inputPatchbay ? inputPatchbay->cableGeneration.load() : 0;
+			std::copy(millivolts, millivolts + channels, shown.millivolts);
 
-		if(cableText != "") {
-			// cableText already starts with newline
-			text += cableText;
+			buildText(mod, idx, inputPatchbay, upstreamIdx);
 		}
-
 	}
 
 	Tooltip::step();
@@ -505,6 +1301,56 @@ void PatchbayOutPortTooltip::step() {
 	box = box.nudge(parent->box.zeroPos());
 };
 
+void PatchbayOutPortTooltip::buildText(PatchbayOut* mod, int idx, PatchbayIn* inputPatchbay, int upstreamIdx) {
+	// The final tooltip text is going to have these four parts.
+	std::string labelText = "";
+	std::string description = ""; // Note: PatchbayOutPortWidget doesn't actually have a description, but this is here for completeness anyway.
+	std::string voltageText = "";
+	std::string cableText = "";
+
+	engine::PortInfo* portInfo = portWidget->getPortInfo();
+
+	description = portInfo->getDescription();
+
+	// Get voltage text based on the number of channels
+	for (int i = 0; i < shown.channels; i++) {
+		float v = shown.millivolts[i] / 1000.f;
+		// Add newline or comma
+		voltageText += "\n";
+		if (shown.channels > 1)
+			voltageText += string::f("%d: ", i + 1);
+		voltageText += string::f("% .3fV", math::normalizeZero(v));
+	}
+
+	labelText = portInfo->getFullName();
+
+	// The cables going out of this port and the cable into the corresponding
+	// port on the other end of the Patchbay. Both are cached by the modules
+	// and only looked up again after cables changed.
+	if(inputPatchbay) {
+		labelText += inputPatchbay->getCableText(upstreamIdx);
+	}
+	cableText = mod->getCableText(idx);
+
+	// Assemble the final tooltip text.
+	text = labelText;
+
+	if(description != "") {
+		text += "\n";
+		text += description;
+	}
+
+	if(voltageText != "") {
+		// voltageText already starts with newline
+		text += voltageText;
+	}
+
+	if(cableText != "") {
+		// cableText already starts with newline
+		text += cableText;
+	}
+}
+
 
 
 
@@ -512,19 +1358,120 @@ void PatchbayOutPortTooltip::step() {
 // module widgets //
 ////////////////////
 
+template <int PORTS>
 struct PatchbayOutWidget : PatchbayModuleWidget {
 	PatchbaySourceSelectorTextBox *labelDisplay;
 
-	PatchbayOutWidget(PatchbayOut *module) : PatchbayModuleWidget(module, "res/PB-I.svg") {
-		for(int i = 0; i < NUM_PATCHBAY_INPUTS; i++) {
+	// how often remote routes are refreshed, in UI frames
+	static const int REMOTE_REFRESH_DIVISION = 60;
+	dsp::ClockDivider remoteRefreshDivider;
+
+	// the 4 port variant has its own panel without the lower port backgrounds
+	PatchbayOutWidget(PatchbayOutModule<PORTS> *module) : PatchbayModuleWidget(module, PORTS == 4 ? "res/PB-I-4.svg" : "res/PB-I.svg", PORTS) {
+		for(int i = 0; i < PORTS; i++) {
 			labelDisplay = new PatchbaySourceSelectorTextBox();
 			labelDisplay->module = module;
 			labelDisplay->idx = i;
 			addLabelDisplay(labelDisplay, i);
 
-			addOutput(createOutputCentered<PatchbayOutPortWidget>(Vec(30, getPortYCoord(i)), module, PatchbayOut::OUTPUT_1 + i));
-			addChild(createTinyLightForPort<GreenRedLight>(Vec(44, 11.0f + getLabelYCoord(i)), module, PatchbayOut::OUTPUT_1_LIGHTG + 2*i));
+			float x = getColumnXCoord(i);
+			addOutput(createOutputCentered<PatchbayOutPortWidget>(Vec(30 + x, getPortYCoord(i)), module, PatchbayOut::OUTPUT_1 + i));
+			addChild(createTinyLightForPort<GreenRedLight>(Vec(44 + x, 11.0f + getLabelYCoord(i)), module, PatchbayOut::OUTPUT_1_LIGHTG + 2*i));
 		}
+
+		remoteRefreshDivider.setDivision(REMOTE_REFRESH_DIVISION);
+	}
+
+	void step() override {
+		PatchbayModuleWidget::step();
+		if(module) {
+			PatchbayOut *module = static_cast<PatchbayOut*>(this->module);
+			module->flushCommands();
+			if(remoteRefreshDivider.process()) {
+				module->refreshRemoteInputs();
+			}
+		}
+	}
+
+	// One submenu per port. Option 0 is audio rate, then each division with
+	// hold and linear interpolation.
+	static void appendRatesMenu(Menu *menu, int64_t moduleId) {
+		static const int divisions[] = {4, 16, 64, 256};
+		std::vector<std::string> options = {"Audio rate"};
+		for(int division : divisions) {
+			options.push_back(string::f("Every %d samples, hold", division));
+			options.push_back(string::f("Every %d samples, linear", division));
+		}
+
+		for(int i = 0; i < PORTS; i++) {
+			menu->addChild(createIndexSubmenuItem(string::f("Port %d", i + 1), options,
+				[=]() -> size_t {
+					PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+					if(!module) return 0;
+					const PatchbayOut::PortRate &rate = module->rates[i];
+					for(int d = 0; d < 4; d++) {
+						if(rate.division == divisions[d]) {
+							return 1 + 2 * d + rate.linear;
+						}
+					}
+					return 0;
+				},
+				[=](size_t option) {
+					PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+					if(!module) {
+						return;
+					}
+					if(option == 0) {
+						module->setRate(i, 1, false);
+					} else {
+						module->setRate(i, divisions[(option - 1) / 2], (option - 1) % 2);
+					}
+				}
+			));
+		}
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		PatchbayOut *module = dynamic_cast<PatchbayOut*>(this->module);
+		int64_t moduleId = module->id;
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createBoolMenuItem("Fixed 1-sample delay", "",
+			[=]() {
+				PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+				return module && module->delayedTransport;
+			},
+			[=](bool delayedTransport) {
+				PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+				if(module) module->setDelayedTransport(delayedTransport);
+			}
+		));
+		menu->addChild(createBoolMenuItem(string::f("Unbundle port 1 to ports 1-%d", module->busChannels), "",
+			[=]() {
+				PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+				return module && module->unbundle;
+			},
+			[=](bool unbundle) {
+				PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+				if(module) module->setUnbundle(unbundle);
+			}
+		));
+		menu->addChild(createSubmenuItem("Port rates", "", [=](Menu *menu) {
+			appendRatesMenu(menu, moduleId);
+		}));
+#ifdef PATCHBAY_SHARED_TRANSPORT
+		menu->addChild(createBoolMenuItem("Receive labels from other Rack instances", "",
+			[=]() {
+				PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+				return module && module->receiveRemote;
+			},
+			[=](bool receiveRemote) {
+				PatchbayOut *module = findPatchbayModule<PatchbayOut>(moduleId);
+				if(module) module->setReceiveRemote(receiveRemote);
+			}
+		));
+#endif
+		appendDiagnosticsMenu(menu);
 	}
 };
 
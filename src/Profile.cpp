@@ -0,0 +1,127 @@
+#include "Profile.hpp"
+
+#ifdef PATCHBAY_PROFILE
+
+#include <functional>
+#include <thread>
+
+namespace profile {
+
+struct alignas(64) ThreadHistograms {
+	// hash of the ID of the thread recording here, 0 while the slot is free
+	std::atomic<size_t> owner;
+	Histogram sections[NUM_PROFILE_SECTIONS];
+
+	ThreadHistograms() : owner(0) {}
+};
+
+// record() runs on the engine threads, so it must not lock or allocate. A
+// thread claims a free slot with a CAS on its first record() and finds it
+// again by its ID, starting at the slot the ID hashes to. That's also why
+// there's no thread_local: TLS of a dlopen()ed plugin is allocated on a
+// thread's first access. Slots are kept after their thread exits, a new
+// thread with the same ID carries on counting in them. Threads finding all
+// slots taken share the last one, with atomic increments.
+static const int NUM_SLOTS = 32;
+static ThreadHistograms slots[NUM_SLOTS + 1];
+static ThreadHistograms &sharedSlot = slots[NUM_SLOTS];
+
+static const char *sectionNames[NUM_PROFILE_SECTIONS] = {
+	"PatchbayIn::process",
+	"PatchbayOut::process",
+	"PatchbayIn::updateLabel",
+	"PatchbayOut::attachInputs",
+	"PatchbayIn::attachDestinations",
+	"dataFromJson",
+};
+
+static ThreadHistograms &getSlot() {
+	// never 0, which marks a free slot
+	size_t id = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+
+	for(int n = 0; n < NUM_SLOTS; n++) {
+		ThreadHistograms &slot = slots[(id + n) % NUM_SLOTS];
+		size_t owner = slot.owner.load(std::memory_order_relaxed);
+		if(owner == id) return slot;
+		// otherwise taken, possibly by another thread just now
+		if(owner == 0 && slot.owner.compare_exchange_strong(owner, id, std::memory_order_relaxed)) return slot;
+	}
+	return sharedSlot;
+}
+
+void record(ProfileSection section, uint64_t ns) {
+	ThreadHistograms &slot = getSlot();
+	Histogram &h = slot.sections[section];
+	int b = ns ? 63 - __builtin_clzll(ns) : 0;
+	if(b >= NUM_BUCKETS) b = NUM_BUCKETS - 1;
+
+	if(&slot == &sharedSlot) {
+		h.buckets[b].fetch_add(1, std::memory_order_relaxed);
+		uint64_t max = h.max.load(std::memory_order_relaxed);
+		while(ns > max && !h.max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+		return;
+	}
+
+	h.buckets[b].store(h.buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if(ns > h.max.load(std::memory_order_relaxed)) {
+		h.max.store(ns, std::memory_order_relaxed);
+	}
+}
+
+Stats getStats(ProfileSection section) {
+	uint64_t buckets[NUM_BUCKETS] = {};
+	Stats stats;
+
+	// free slots are all zero
+	for(ThreadHistograms &slot : slots) {
+		Histogram &h = slot.sections[section];
+		for(int b = 0; b < NUM_BUCKETS; b++) {
+			buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+		}
+		stats.max = std::max(stats.max, h.max.load(std::memory_order_relaxed));
+	}
+
+	for(int b = 0; b < NUM_BUCKETS; b++) {
+		stats.count += buckets[b];
+	}
+	if(stats.count == 0) return stats;
+
+	uint64_t seen = 0;
+	for(int b = 0; b < NUM_BUCKETS; b++) {
+		seen += buckets[b];
+		uint64_t upper = std::min((uint64_t) 2 << b, stats.max);
+		if(!stats.p50 && 2 * seen >= stats.count) {
+			stats.p50 = upper;
+		}
+		if(!stats.p99 && 100 * seen >= 99 * stats.count) {
+			stats.p99 = upper;
+			break;
+		}
+	}
+
+	return stats;
+}
+
+const char *getSectionName(ProfileSection section) {
+	return sectionNames[section];
+}
+
+json_t *toJson() {
+	json_t *data = json_object();
+
+	for(int s = 0; s < NUM_PROFILE_SECTIONS; s++) {
+		Stats stats = getStats((ProfileSection) s);
+		json_t *stats_json = json_object();
+		json_object_set_new(stats_json, "count", json_integer(stats.count));
+		json_object_set_new(stats_json, "p50_ns", json_integer(stats.p50));
+		json_object_set_new(stats_json, "p99_ns", json_integer(stats.p99));
+		json_object_set_new(stats_json, "max_ns", json_integer(stats.max));
+		json_object_set_new(data, sectionNames[s], stats_json);
+	}
+
+	return data;
+}
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+// Scoped timers for the hot paths, built with `make PATCHBAY_PROFILE=1`.
+// Without it PATCHBAY_PROFILE_SCOPE() expands to nothing and none of this is
+// compiled in.
+
+#include "plugin.hpp"
+
+enum ProfileSection {
+	PROFILE_IN_PROCESS,
+	PROFILE_OUT_PROCESS,
+	PROFILE_UPDATE_LABEL,
+	PROFILE_ATTACH_INPUTS,
+	PROFILE_ATTACH_DESTINATIONS,
+	PROFILE_DATA_FROM_JSON,
+	NUM_PROFILE_SECTIONS
+};
+
+#ifdef PATCHBAY_PROFILE
+
+#include <atomic>
+#include <chrono>
+
+namespace profile {
+
+// Durations in nanoseconds, bucket b counting the ones in [2^b, 2^(b+1)).
+static const int NUM_BUCKETS = 40;
+
+// Every thread records into its own histograms, so there's a single writer
+// and counts are bumped with a relaxed load and store. Readers sum them over
+// all threads. See Profile.cpp for threads that find no histograms of their own.
+struct Histogram {
+	std::atomic<uint64_t> buckets[NUM_BUCKETS];
+	std::atomic<uint64_t> max;
+
+	Histogram() : max(0) {
+		for(int b = 0; b < NUM_BUCKETS; b++) {
+			buckets[b].store(0);
+		}
+	}
+};
+
+struct Stats {
+	uint64_t count = 0;
+	// upper bounds of the buckets holding the percentiles, in nanoseconds
+	uint64_t p50 = 0;
+	uint64_t p99 = 0;
+	uint64_t max = 0;
+};
+
+void record(ProfileSection section, uint64_t ns);
+Stats getStats(ProfileSection section);
+const char *getSectionName(ProfileSection section);
+json_t *toJson();
+
+struct ScopedTimer {
+	ProfileSection section;
+	std::chrono::steady_clock::time_point start;
+
+	ScopedTimer(ProfileSection section) : section(section), start(std::chrono::steady_clock::now()) {}
+
+	~ScopedTimer() {
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		record(section, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	}
+};
+
+}
+
+#define PATCHBAY_PROFILE_SCOPE(section) profile::ScopedTimer patchbayProfileTimer(section)
+
+#else
+
+#define PATCHBAY_PROFILE_SCOPE(section)
+
+#endif
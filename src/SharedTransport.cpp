@@ -0,0 +1,256 @@
+#include "SharedTransport.hpp"
+#include "LabelRegistry.hpp"
+
+#ifdef PATCHBAY_SHARED_TRANSPORT
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <new>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// other processes only ever see the atomics through the mapping
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2, "shared memory needs lock-free atomics");
+
+// bumped whenever the layout of SharedSegment changes
+static const uint32_t SEGMENT_MAGIC = 0x50427932;
+static const char SEGMENT_PREFIX[] = "JonBiz-Patchbay-";
+
+// Letters, digits, '-' and '_' are kept, everything else is escaped as %XX,
+// so any label makes a valid name and can be told back from it.
+static std::string segmentName(const std::string &label) {
+	std::string name = "/";
+	name += SEGMENT_PREFIX;
+	for(char c : label) {
+		if(std::isalnum((uint8_t) c) || c == '-' || c == '_') {
+			name += c;
+		} else {
+			name += string::f("%%%02X", (uint8_t) c);
+		}
+	}
+#if defined(ARCH_MAC)
+	// names are limited to 31 characters there
+	if(name.size() > 31) {
+		name = string::f("/%s%08x", SEGMENT_PREFIX, LabelRegistry::hash(label));
+	}
+#endif
+	return name;
+}
+
+static bool processAlive(int32_t pid) {
+	return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static SharedSegment *mapSegment(int fd) {
+	void *p = mmap(NULL, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return p == MAP_FAILED ? NULL : (SharedSegment*) p;
+}
+
+static void unmapSegment(SharedSegment *segment) {
+	munmap(segment, sizeof(SharedSegment));
+}
+
+// Map the existing segment name, NULL if there is none or it isn't ours.
+static SharedSegment *openSegment(const std::string &name) {
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0) return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SharedSegment)) {
+		close(fd);
+		return NULL;
+	}
+
+	SharedSegment *segment = mapSegment(fd);
+	if(segment && segment->magic != SEGMENT_MAGIC) {
+		unmapSegment(segment);
+		return NULL;
+	}
+	return segment;
+}
+
+static bool writerAlive(const SharedSegment *segment) {
+	return processAlive(segment->writerPid.load(std::memory_order_acquire));
+}
+
+SharedWriter *openSharedWriter(const std::string &label) {
+	std::string name = segmentName(label);
+
+	SharedSegment *existing = openSegment(name);
+	if(existing) {
+		bool taken = writerAlive(existing);
+		unmapSegment(existing);
+		if(taken) return NULL;
+		// left behind by an instance that crashed
+		shm_unlink(name.c_str());
+	}
+
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0) {
+		// EEXIST: another instance got there first
+		if(errno != EEXIST) WARN("Could not create shared memory %s", name.c_str());
+		return NULL;
+	}
+	if(ftruncate(fd, sizeof(SharedSegment)) != 0) {
+		close(fd);
+		shm_unlink(name.c_str());
+		return NULL;
+	}
+
+	SharedSegment *segment = mapSegment(fd);
+	if(!segment) {
+		shm_unlink(name.c_str());
+		return NULL;
+	}
+
+	new (segment) SharedSegment();
+	segment->magic = SEGMENT_MAGIC;
+	segment->readerPid.store(0);
+	segment->writerPid.store(getpid(), std::memory_order_release);
+
+	SharedWriter *writer = new SharedWriter();
+	writer->label = label;
+	writer->name = name;
+	writer->segment = segment;
+	return writer;
+}
+
+void closeSharedWriter(SharedWriter *writer) {
+	if(!writer) return;
+
+	writer->segment->writerPid.store(0, std::memory_order_release);
+	shm_unlink(writer->name.c_str());
+	retire([=]() {
+		unmapSegment(writer->segment);
+		delete writer;
+	});
+}
+
+// open remote sources by label, UI thread only
+static std::map<std::string, RemoteSource*> &getRemoteSources() {
+	static std::map<std::string, RemoteSource*> sources;
+	return sources;
+}
+
+RemoteSource *acquireRemoteSource(const std::string &label) {
+	std::map<std::string, RemoteSource*> &sources = getRemoteSources();
+	auto it = sources.find(label);
+	if(it != sources.end()) {
+		if(it->second->isAlive()) {
+			it->second->refs++;
+			return it->second;
+		}
+		// its writer is gone, the ports still holding it let go of it on
+		// their next refresh
+		sources.erase(it);
+	}
+
+	std::string name = segmentName(label);
+	SharedSegment *segment = openSegment(name);
+	if(!segment) return NULL;
+
+	int32_t reader = segment->readerPid.load();
+	if(!writerAlive(segment) || (processAlive(reader) && reader != getpid())
+		|| !segment->readerPid.compare_exchange_strong(reader, getpid())) {
+		unmapSegment(segment);
+		return NULL;
+	}
+	// whatever was queued for a previous reader is stale
+	segment->ring.drop(segment->ring.size());
+
+	RemoteSource *source = new RemoteSource();
+	source->label = label;
+	source->name = name;
+	source->segment = segment;
+	source->refs = 1;
+	sources[label] = source;
+	return source;
+}
+
+void releaseRemoteSource(RemoteSource *source) {
+	if(--source->refs > 0) return;
+
+	std::map<std::string, RemoteSource*> &sources = getRemoteSources();
+	auto it = sources.find(source->label);
+	if(it != sources.end() && it->second == source) {
+		sources.erase(it);
+	}
+	// let the writer stop queueing right away
+	int32_t pid = getpid();
+	source->segment->readerPid.compare_exchange_strong(pid, 0);
+	retire([=]() {
+		unmapSegment(source->segment);
+		delete source;
+	});
+}
+
+bool RemoteSource::isAlive() const {
+	return writerAlive(segment);
+}
+
+std::vector<std::string> listSharedLabels() {
+	std::vector<std::string> labels;
+#if defined(ARCH_LIN)
+	DIR *dir = opendir("/dev/shm");
+	if(!dir) return labels;
+
+	size_t prefixLength = sizeof(SEGMENT_PREFIX) - 1;
+	while(struct dirent *entry = readdir(dir)) {
+		std::string file = entry->d_name;
+		if(file.compare(0, prefixLength, SEGMENT_PREFIX) != 0) continue;
+
+		// undo segmentName()
+		std::string label;
+		for(size_t i = prefixLength; i < file.size(); i++) {
+			if(file[i] == '%' && i + 2 < file.size()) {
+				label += (char) std::strtol(file.substr(i + 1, 2).c_str(), NULL, 16);
+				i += 2;
+			} else {
+				label += file[i];
+			}
+		}
+		if(label.empty() || segmentName(label) != "/" + file) continue;
+
+		SharedSegment *segment = openSegment("/" + file);
+		if(!segment) continue;
+		if(writerAlive(segment)) {
+			labels.push_back(label);
+		}
+		unmapSegment(segment);
+	}
+	closedir(dir);
+#endif
+	return labels;
+}
+
+#else
+
+SharedWriter *openSharedWriter(const std::string &label) {
+	return NULL;
+}
+
+void closeSharedWriter(SharedWriter *writer) {}
+
+RemoteSource *acquireRemoteSource(const std::string &label) {
+	return NULL;
+}
+
+void releaseRemoteSource(RemoteSource *source) {}
+
+bool RemoteSource::isAlive() const {
+	return false;
+}
+
+std::vector<std::string> listSharedLabels() {
+	return std::vector<std::string>();
+}
+
+#endif
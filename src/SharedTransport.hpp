@@ -0,0 +1,207 @@
+#pragma once
+
+// Labels shared with other Rack instances on the same host. A PatchbayIn port
+// can publish its frames into a POSIX shared memory segment named after its
+// label, and a PatchbayOut in another instance that doesn't find the label
+// locally reads them from there. Each segment is a single producer, single
+// consumer ring of PortFrames: one writing process publishes into it in
+// place and at most one reading process reads it in place.
+//
+// The engines of the two instances run on their own clocks and process in
+// blocks, so the ring absorbs the jitter between them. The reader waits for
+// SHARED_TARGET_LATENCY frames before it starts, holds the last frame and
+// waits again whenever the ring runs dry, and drops frames back down to the
+// target when it lags by more than SHARED_MAX_LATENCY. The fill of the ring
+// is the latency added on top of the local transport, and is reported in the
+// diagnostics.
+//
+// Not available on Windows, where nothing can be opened.
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "plugin.hpp"
+#include "Transport.hpp"
+
+#if !defined(ARCH_WIN)
+#define PATCHBAY_SHARED_TRANSPORT
+#endif
+
+// in frames, the ring size must be a power of two
+static const size_t SHARED_RING_SIZE = 2048;
+static const size_t SHARED_MAX_LATENCY = 1024;
+static const size_t SHARED_TARGET_LATENCY = 256;
+
+// The layout of a segment, the same in every process mapping it.
+struct SharedSegment {
+	uint32_t magic;
+	// the writing process, 0 once it closed the segment
+	std::atomic<int32_t> writerPid;
+	// the reading process, 0 if there is none
+	std::atomic<int32_t> readerPid;
+	// frames are written in place by the writer and read in place by the
+	// PatchbayOut ports of the reader, nothing is copied in between
+	SpscQueue<PortFrame, SHARED_RING_SIZE> ring;
+};
+
+// The writing end, owned by a PatchbayIn port and pushed to by its engine.
+struct SharedWriter {
+	std::string label;
+	std::string name;
+	SharedSegment *segment;
+	// frames that didn't fit in the ring, written by the engine
+	std::atomic<uint64_t> dropped;
+
+	SharedWriter() : segment(NULL), dropped(0) {}
+
+	// Publish one frame to the reader, straight into the next slot of the
+	// ring. Nothing is queued while nobody is reading.
+	void push(int64_t frame, const float *voltages, int channels) {
+		if(segment->readerPid.load(std::memory_order_relaxed) == 0) return;
+
+		PortFrame *f = segment->ring.back();
+		if(!f) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		f->channels.store(channels, std::memory_order_relaxed);
+		copyVoltages(f->voltages, voltages, channels);
+		f->stamp.store(frame, std::memory_order_relaxed);
+		segment->ring.commit();
+	}
+};
+
+// The reading end of a shared label. All PatchbayOut ports of this instance
+// that select the label share one, reference counted. It's polled by the
+// engine once per frame, which picks the slot of the ring to serve on that
+// frame, and the ports read it from the segment like they read the buffer of
+// a local PatchbayIn.
+struct RemoteSource {
+	std::string label;
+	std::string name;
+	SharedSegment *segment;
+	// UI thread only
+	int refs;
+
+	// Engine thread only, see poll(). current is the ring position of the
+	// frame served last, -1 before the first one.
+	std::atomic<int64_t> lastPolled;
+	int64_t current;
+	bool buffering;
+
+	// The slot picked for an engine frame. Like a PortBuffer there is one per
+	// parity of the frame, so the one of the previous frame stays readable
+	// while the current one is picked.
+	struct Pick {
+		std::atomic<int64_t> frame;
+		std::atomic<int64_t> position;
+
+		Pick() : frame(-1), position(-1) {}
+	};
+	Pick picks[2];
+
+	// Written by the engine, for the diagnostics: the ring fill after the
+	// last poll in frames, frames held because the ring ran dry, and frames
+	// dropped to catch up.
+	std::atomic<int> latency;
+	std::atomic<uint64_t> underruns;
+	std::atomic<uint64_t> skipped;
+
+	RemoteSource() : segment(NULL), refs(0), lastPolled(-1), current(-1), buffering(true), latency(0), underruns(0), skipped(0) {}
+
+	// Called by every PatchbayOut routed from us before it reads. Engine
+	// frames don't overlap, so whichever engine thread comes first on a frame
+	// is the ring's only consumer for that frame.
+	void poll(int64_t frame) {
+		if(lastPolled.exchange(frame, std::memory_order_relaxed) == frame) return;
+
+		SpscQueue<PortFrame, SHARED_RING_SIZE> &ring = segment->ring;
+		int64_t next = current < 0 ? (int64_t) ring.begin() : current + 1;
+		size_t fill = ring.end() - next;
+
+		if(fill > SHARED_MAX_LATENCY) {
+			skipped.fetch_add(fill - SHARED_TARGET_LATENCY, std::memory_order_relaxed);
+			next += fill - SHARED_TARGET_LATENCY;
+			fill = SHARED_TARGET_LATENCY;
+		}
+		if(buffering && fill >= SHARED_TARGET_LATENCY) {
+			buffering = false;
+		}
+
+		int64_t previous = current;
+		if(!buffering && fill > 0) {
+			current = next;
+			fill--;
+		} else if(!buffering) {
+			// hold the last frame
+			underruns.fetch_add(1, std::memory_order_relaxed);
+			buffering = true;
+		}
+
+		// Ports on other engine threads may still fall back to the frame
+		// served last, everything before it goes back to the writer.
+		ring.dropTo(previous >= 0 ? previous : current >= 0 ? current : next);
+
+		Pick &p = picks[frame & 1];
+		p.position.store(current, std::memory_order_relaxed);
+		p.frame.store(frame, std::memory_order_release);
+
+		latency.store(fill, std::memory_order_relaxed);
+	}
+
+	// Copy the frame served on frame into dst and return its channel count.
+	// Until poll() is done with frame, that's the frame served last.
+	int read(int64_t frame, float *dst) const {
+		const Pick &p = picks[frame & 1];
+		int64_t position = p.frame.load(std::memory_order_acquire) == frame
+			? p.position.load(std::memory_order_relaxed)
+			: getLastPosition();
+		if(position < 0) return 0;
+
+		const PortFrame &f = segment->ring.at(position);
+		// the other process isn't trusted to stay in bounds
+		int channels = clamp(f.channels.load(std::memory_order_relaxed), 0, PORT_MAX_CHANNELS);
+		copyVoltages(dst, f.voltages, channels);
+		return channels;
+	}
+
+	// Channel count of the frame served last, 0 if none was.
+	int getChannels() const {
+		int64_t position = getLastPosition();
+		if(position < 0) return 0;
+		return clamp(segment->ring.at(position).channels.load(std::memory_order_relaxed), 0, PORT_MAX_CHANNELS);
+	}
+
+	// Ring position of the frame served on the last frame polled, -1 if
+	// none was. poll() keeps it in the ring until the next frame.
+	int64_t getLastPosition() const {
+		const Pick &last = picks[0].frame.load(std::memory_order_acquire) >= picks[1].frame.load(std::memory_order_acquire)
+			? picks[0] : picks[1];
+		return last.position.load(std::memory_order_relaxed);
+	}
+
+	// Whether the writer is still there. Once it's gone the source has to be
+	// released, a new writer of the label creates a new segment.
+	bool isAlive() const;
+};
+
+// Create the segment for label. Return NULL if another running instance
+// shares the label already, or on failure.
+SharedWriter *openSharedWriter(const std::string &label);
+
+// Unlink the segment, and unmap it once the engine is done with it.
+void closeSharedWriter(SharedWriter *writer);
+
+// Open label for reading, or add a reference to it if it's open already.
+// Return NULL if no other instance shares it, or if another process reads it
+// already.
+RemoteSource *acquireRemoteSource(const std::string &label);
+
+// Drop a reference, the last one unmaps the segment once the engine is done
+// with it.
+void releaseRemoteSource(RemoteSource *source);
+
+// The labels shared by all instances, including this one. Linux only, empty
+// elsewhere.
+std::vector<std::string> listSharedLabels();
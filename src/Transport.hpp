@@ -0,0 +1,345 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <vector>
+
+#include "plugin.hpp"
+#include "Util.hpp"
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+// One frame of a PatchbayIn port, as published at the end of its process().
+// Each frame sits on its own cache lines so a writer and readers of different
+// slots never share a line.
+struct alignas(CACHE_LINE_SIZE) PortFrame {
+	float voltages[PORT_MAX_CHANNELS] = {};
+	std::atomic<int> channels;
+	// engine frame this slot was last published on
+	std::atomic<int64_t> stamp;
+	// seqlock counter, odd while the slot is being written
+	std::atomic<uint32_t> seq;
+
+	PortFrame() : channels(0), stamp(-1), seq(0) {}
+};
+
+// Double buffer of published frames. During engine frame N the PatchbayIn
+// writes frames[N & 1] while frames[(N + 1) & 1] holds the previous frame and
+// is left alone, so reading it is race-free on any number of engine threads
+// and gives a fixed latency of one sample regardless of processing order.
+struct PortBuffer {
+	PortFrame frames[2];
+
+	void publish(int64_t frame, rack::engine::Input &input) {
+		publish(frame, input.voltages, input.getChannels());
+	}
+
+	// voltages must be PORT_MAX_CHANNELS long, see copyVoltages()
+	void publish(int64_t frame, const float *voltages, int channels) {
+		PortFrame &f = frames[frame & 1];
+		uint32_t seq = beginWrite(f);
+
+		f.channels.store(channels, std::memory_order_relaxed);
+		copyVoltages(f.voltages, voltages, channels);
+
+		endWrite(f, frame, seq);
+	}
+
+	// Publish the first channel of each of count inputs as one polyphonic
+	// frame, channel j coming from inputs[j].
+	void publishBus(int64_t frame, rack::engine::Input *inputs, int count) {
+		PortFrame &f = frames[frame & 1];
+		uint32_t seq = beginWrite(f);
+
+		f.channels.store(count, std::memory_order_relaxed);
+		for(int j = 0; j < count; j++) {
+			f.voltages[j] = inputs[j].getVoltage();
+		}
+
+		endWrite(f, frame, seq);
+	}
+
+	uint32_t beginWrite(PortFrame &f) {
+		uint32_t seq = f.seq.load(std::memory_order_relaxed);
+		f.seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return seq;
+	}
+
+	void endWrite(PortFrame &f, int64_t frame, uint32_t seq) {
+		f.stamp.store(frame, std::memory_order_relaxed);
+		f.seq.store(seq + 2, std::memory_order_release);
+	}
+
+	// Channel count of the most recently published frame, 0 if none was
+	// published yet. Only a hint while the PatchbayIn is being processed.
+	int getChannels() const {
+		const PortFrame &f = frames[0].stamp.load(std::memory_order_relaxed) >= frames[1].stamp.load(std::memory_order_relaxed)
+			? frames[0] : frames[1];
+		if(f.stamp.load(std::memory_order_relaxed) < 0) return 0;
+		return f.channels.load(std::memory_order_relaxed);
+	}
+
+	const PortFrame &previous(int64_t frame) const {
+		return frames[(frame + 1) & 1];
+	}
+
+	// Copy the previous frame into dst and return its channel count. A frame
+	// published longer ago than that is stale, the PatchbayIn stopped
+	// publishing, and reads as 0 channels.
+	int readPrevious(int64_t frame, float *dst) const {
+		const PortFrame &f = previous(frame);
+		if(f.stamp.load(std::memory_order_relaxed) != frame - 1) return 0;
+		int channels = f.channels.load(std::memory_order_relaxed);
+		copyVoltages(dst, f.voltages, channels);
+		return channels;
+	}
+
+	// Copy the most recent complete frame into dst and return its channel
+	// count. That's the current frame if the PatchbayIn was already processed
+	// during this engine frame, otherwise the previous one. The current slot
+	// may be written concurrently by another engine thread, the seqlock makes
+	// us fall back to the previous frame instead of returning a torn one.
+	int readLatest(int64_t frame, float *dst) const {
+		const PortFrame &f = frames[frame & 1];
+		uint32_t seq = f.seq.load(std::memory_order_acquire);
+
+		if(!(seq & 1) && f.stamp.load(std::memory_order_relaxed) == frame) {
+			int channels = f.channels.load(std::memory_order_relaxed);
+			copyVoltages(dst, f.voltages, channels);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(f.seq.load(std::memory_order_relaxed) == seq) {
+				return channels;
+			}
+		}
+
+		return readPrevious(frame, dst);
+	}
+};
+
+// operator new only guarantees 16 byte alignment before C++17, so the buffers
+// are placed in over-allocated memory by hand. The original pointer is kept
+// just before the aligned block.
+inline PortBuffer *createPortBuffers(int count) {
+	size_t size = count * sizeof(PortBuffer) + CACHE_LINE_SIZE + sizeof(void*);
+	char *raw = (char*) std::malloc(size);
+	if(!raw) throw std::bad_alloc();
+
+	uintptr_t start = (uintptr_t) (raw + sizeof(void*));
+	uintptr_t aligned = (start + CACHE_LINE_SIZE - 1) & ~(uintptr_t) (CACHE_LINE_SIZE - 1);
+	((void**) aligned)[-1] = raw;
+
+	PortBuffer *buffers = (PortBuffer*) aligned;
+	for(int i = 0; i < count; i++) {
+		new (&buffers[i]) PortBuffer();
+	}
+	return buffers;
+}
+
+inline void destroyPortBuffers(PortBuffer *buffers, int count) {
+	if(!buffers) return;
+
+	for(int i = 0; i < count; i++) {
+		buffers[i].~PortBuffer();
+	}
+	std::free(((void**) buffers)[-1]);
+}
+
+// Wait-free queue with a single producer and a single consumer thread. SIZE
+// must be a power of two. head and tail only ever grow, their difference is
+// the number of queued items.
+template <typename T, size_t SIZE>
+struct SpscQueue {
+	T items[SIZE];
+	// next item to pop, only written by the consumer
+	std::atomic<size_t> head;
+	char headPadding[CACHE_LINE_SIZE];
+	// next slot to push to, only written by the producer
+	std::atomic<size_t> tail;
+
+	SpscQueue() : head(0), tail(0) {}
+
+	// Return false if the queue is full.
+	bool push(const T &item) {
+		T *slot = back();
+		if(!slot) return false;
+		*slot = item;
+		commit();
+		return true;
+	}
+
+	// Return false if the queue is empty.
+	bool pop(T &item) {
+		const T *f = front();
+		if(!f) return false;
+		item = *f;
+		drop(1);
+		return true;
+	}
+
+	// Producer: the slot to fill in place, NULL if the queue is full. It's
+	// only queued by commit().
+	T *back() {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if(t - head.load(std::memory_order_acquire) == SIZE) {
+			return NULL;
+		}
+		return &items[t & (SIZE - 1)];
+	}
+
+	void commit() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: the next item, read in place, NULL if the queue is empty. It
+	// stays valid until it's dropped.
+	const T *front() const {
+		size_t h = head.load(std::memory_order_relaxed);
+		if(h == tail.load(std::memory_order_acquire)) {
+			return NULL;
+		}
+		return &items[h & (SIZE - 1)];
+	}
+
+	// Consumer: discard the next n items, n must be at most size().
+	void drop(size_t n) {
+		head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+	// Consumer: positions count items like head and tail do, begin() is the
+	// next item to pop and end() one past the last queued one.
+	size_t begin() const {
+		return head.load(std::memory_order_relaxed);
+	}
+
+	size_t end() const {
+		return tail.load(std::memory_order_acquire);
+	}
+
+	// Consumer: the item at position, read in place. It must be queued.
+	const T &at(size_t position) const {
+		return items[position & (SIZE - 1)];
+	}
+
+	// Consumer: discard the items before position.
+	void dropTo(size_t position) {
+		head.store(position, std::memory_order_release);
+	}
+
+	// Consumer: the number of queued items.
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+	}
+};
+
+// Route changes queued for a PatchbayOut by the UI thread, and applied by it
+// on the engine thread, see PatchbayOut::pushCommand(). Commands of all
+// modules are numbered from one sequence, getRouteCommandSeq().
+struct RouteCommandStats {
+	// UI thread
+	uint64_t pushed = 0;
+	// engine thread: the number of commands applied and the sequence number
+	// of the last one
+	std::atomic<uint64_t> applied;
+	std::atomic<uint64_t> appliedSeq;
+
+	RouteCommandStats() : applied(0), appliedSeq(0) {}
+
+	// Whether every command numbered below seq was applied: there's nothing
+	// left to apply, or a later command was applied already.
+	bool hasApplied(uint64_t seq) const {
+		return applied.load(std::memory_order_acquire) == pushed || appliedSeq.load(std::memory_order_acquire) >= seq;
+	}
+};
+
+// The number of the next command, UI thread only.
+inline uint64_t &getRouteCommandSeq() {
+	static uint64_t seq = 1;
+	return seq;
+}
+
+// The command stats of every PatchbayOut in the engine, the modules that can
+// be reading through a route. UI thread only.
+inline std::vector<RouteCommandStats*> &getRouteConsumers() {
+	static std::vector<RouteCommandStats*> consumers;
+	return consumers;
+}
+
+inline void addRouteConsumer(RouteCommandStats *stats) {
+	getRouteConsumers().push_back(stats);
+}
+
+inline void removeRouteConsumer(RouteCommandStats *stats) {
+	std::vector<RouteCommandStats*> &consumers = getRouteConsumers();
+	for(size_t i = 0; i < consumers.size(); i++) {
+		if(consumers[i] == stats) {
+			consumers[i] = consumers.back();
+			consumers.pop_back();
+			return;
+		}
+	}
+}
+
+// The buffers of a deleted PatchbayIn may still be read by a PatchbayOut
+// until it has applied the removal of its route, which is queued. Rather than
+// waiting for the engine, they're retired with the engine frame and command
+// sequence number they were unlinked at. They're freed once every PatchbayOut
+// in the engine has applied the commands queued before that, and the engine
+// is two frames further, so process() calls still holding them have returned
+// too (PatchbayIn reads its shared writers without commands). The same goes
+// for anything else the engine reads through a route, like shared memory
+// mappings. UI thread only.
+struct Retired {
+	std::function<void()> destroy;
+	int64_t frame;
+	uint64_t seq;
+};
+
+inline std::vector<Retired> &getRetired() {
+	static std::vector<Retired> retired;
+	return retired;
+}
+
+inline bool isRetiredUnused(const Retired &r, int64_t frame) {
+	if(frame < r.frame + 2) return false;
+	for(RouteCommandStats *consumer : getRouteConsumers()) {
+		if(!consumer->hasApplied(r.seq)) return false;
+	}
+	return true;
+}
+
+// Free what no engine thread can be reading anymore. Called regularly from
+// widget step(), when modules are added and removed, and on every retirement.
+inline void reclaimRetired() {
+	std::vector<Retired> &retired = getRetired();
+	if(retired.empty()) return;
+
+	int64_t frame = APP->engine->getFrame();
+	for(size_t i = 0; i < retired.size();) {
+		if(isRetiredUnused(retired[i], frame)) {
+			retired[i].destroy();
+			retired[i] = retired.back();
+			retired.pop_back();
+		} else {
+			i++;
+		}
+	}
+}
+
+inline void retire(std::function<void()> destroy) {
+	Retired r;
+	r.destroy = destroy;
+	r.frame = APP->engine->getFrame();
+	r.seq = getRouteCommandSeq();
+	getRetired().push_back(r);
+
+	reclaimRetired();
+}
+
+inline void retirePortBuffers(PortBuffer *buffers, int count) {
+	retire([=]() {
+		destroyPortBuffers(buffers, count);
+	});
+}
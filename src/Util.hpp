@@ -1,3 +1,5 @@
+#pragma once
+
 // some utility functions
 
 #include "rack.hpp"
@@ -23,8 +25,23 @@ TinyLight<TLightColor> *createTinyLightForPort(Vec portCenterPos, Module *module
 			module, firstLightId);
 }
 
-// generate random alphanumeric string
-std::string randomString(size_t len);
+// Copy the first `channels` voltages of a port four at a time. Port voltage
+// arrays are always PORT_MAX_CHANNELS long, so rounding the count up to a
+// multiple of 4 stays in bounds; channels past `channels` are ignored by Rack.
+inline void copyVoltages(float *dst, const float *src, int channels) {
+	if(channels == 1) {
+		dst[0] = src[0];
+	} else if(channels == PORT_MAX_CHANNELS) {
+		simd::float_4::load(src).store(dst);
+		simd::float_4::load(src + 4).store(dst + 4);
+		simd::float_4::load(src + 8).store(dst + 8);
+		simd::float_4::load(src + 12).store(dst + 12);
+	} else {
+		for(int c = 0; c < channels; c += 4) {
+			simd::float_4::load(src + c).store(dst + c);
+		}
+	}
+}
 
 struct GUITimer {
 	// Kinda like dsp::PulseGenerator, but uses std::chrono for timing events, since
@@ -1,5 +1,24 @@
 #include "Widgets.hpp"
 
+std::shared_ptr<Font> TextBox::getFont() {
+	if(resolvedFontPath.empty()) {
+		resolvedFontPath = asset::plugin(pluginInstance, fontPath);
+	}
+	return APP->window->loadFont(resolvedFontPath);
+}
+
+void TextBox::step() {
+	TransparentWidget::step();
+
+	if(dirty) {
+		FramebufferWidget *fb = getAncestorOfType<FramebufferWidget>();
+		if(fb) {
+			fb->setDirty();
+		}
+		dirty = false;
+	}
+}
+
 void TextBox::draw(const DrawArgs &args) {
 	// based on LedDisplayChoice::draw() in Rack/src/app/LedDisplay.cpp
 	auto vg = args.vg;
@@ -10,7 +29,7 @@ void TextBox::draw(const DrawArgs &args) {
 	nvgFillColor(vg, backgroundColor);
 	nvgFill(vg);
 
-	std::shared_ptr<Font> font = APP->window->loadFont(asset::plugin(pluginInstance, fontPath));
+	std::shared_ptr<Font> font = getFont();
 
 	if (font && font->handle >= 0) {
 
@@ -29,14 +48,16 @@ void TextBox::draw(const DrawArgs &args) {
 void EditableTextBox::draw(const DrawArgs &args) {
 	auto vg = args.vg;
 
+	// swapped directly rather than through setText(), which would mark the
+	// box dirty from inside draw()
 	std::string tmp = HoverableTextBox::text;
 	if(isFocused) {
 		// if we're editing, display Textfield::text
-		HoverableTextBox::setText(TextField::text);
+		HoverableTextBox::text = TextField::text;
 	}
 
 	HoverableTextBox::draw(args);
-	HoverableTextBox::setText(tmp);
+	HoverableTextBox::text = tmp;
 
 	if(isFocused) {
 		NVGcolor highlightColor = nvgRGB(0x0, 0x90, 0xd8);
@@ -12,8 +12,16 @@ struct TextBox : TransparentWidget {
 	float letter_spacing;
 	Vec textOffset;
 	NVGcolor defaultTextColor;
-	NVGcolor textColor; // This can be used to temporarily override text color
+	NVGcolor textColor; // This can be used to temporarily override text color, see setTextColor()
 	NVGcolor backgroundColor;
+	// Resolved on first draw. The font itself is looked up on every draw,
+	// Window caches it by path and may reload it, e.g. for a new GL context,
+	// so we don't hold on to one.
+	std::string resolvedFontPath;
+
+	// Set when what's displayed has changed. Text boxes are usually drawn
+	// through a FramebufferWidget, which is only redrawn once marked dirty.
+	bool dirty = true;
 
 	TextBox() {
 		defaultTextColor = nvgRGB(0x23, 0x23, 0x23);
@@ -26,8 +34,27 @@ struct TextBox : TransparentWidget {
 		textOffset = Vec(box.size.x * 0.5f, 0.f);
 	}
 
-	virtual void setText(std::string s) { text = s; }
+	virtual void setText(const std::string &s) {
+		if(s != text) {
+			text = s;
+			dirty = true;
+		}
+	}
+
+	void setTextColor(NVGcolor color) {
+		if(!isColorEqual(color, textColor)) {
+			textColor = color;
+			dirty = true;
+		}
+	}
+
+	static bool isColorEqual(NVGcolor a, NVGcolor b) {
+		return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+	}
+
+	std::shared_ptr<Font> getFont();
 
+	virtual void step() override;
 	virtual void draw(const DrawArgs &args) override;
 
 };
@@ -49,9 +76,11 @@ struct HoverableTextBox : TextBox {
 
 	void onEnter(const event::Enter &e) override {
 		state = BND_HOVER;
+		dirty = true;
 	}
 	void onLeave(const event::Leave &e) override {
 		state = BND_DEFAULT;
+		dirty = true;
 	}
 
 	void draw(const DrawArgs &args) override {
@@ -71,6 +100,7 @@ struct HoverableTextBox : TextBox {
 struct EditableTextBox : HoverableTextBox, TextField {
 
 	bool isFocused = false;
+	bool wasFocused = false;
 	const static unsigned int defaultTextLength = 4;
 	const static unsigned int maxTextLength = 16;
 
@@ -114,6 +144,13 @@ struct EditableTextBox : HoverableTextBox, TextField {
 
 	void step() override {
 		TextField::step();
+		// the cursor and selection can change with any key press, just
+		// redraw while editing, and once more after
+		if(isFocused || wasFocused) {
+			dirty = true;
+		}
+		wasFocused = isFocused;
+		HoverableTextBox::step();
 	}
 
 };
@@ -9,6 +9,12 @@ void init(Plugin *p) {
 
 	p->addModel(modelPatchbayInModule);
 	p->addModel(modelPatchbayOutModule);
+	p->addModel(modelPatchbayIn4Module);
+	p->addModel(modelPatchbayOut4Module);
+	p->addModel(modelPatchbayIn16Module);
+	p->addModel(modelPatchbayOut16Module);
+	p->addModel(modelPatchbayIn32Module);
+	p->addModel(modelPatchbayOut32Module);
 
 	// Any other plugin initialization may go here.
 	// As an alternative, consider lazy-loading assets and lookup tables when your module is created to reduce startup times of Rack.
@@ -11,3 +11,9 @@ extern Plugin *pluginInstance;
 // Declare each Model, defined in each module source file
 extern Model *modelPatchbayInModule;
 extern Model *modelPatchbayOutModule;
+extern Model *modelPatchbayIn4Module;
+extern Model *modelPatchbayOut4Module;
+extern Model *modelPatchbayIn16Module;
+extern Model *modelPatchbayOut16Module;
+extern Model *modelPatchbayIn32Module;
+extern Model *modelPatchbayOut32Module;